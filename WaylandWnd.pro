@@ -10,13 +10,50 @@ LIBS += -lwayland-client -lpng -lm -lpthread
 
 
 SOURCES += \
+        alpha-modifier-v1-protocol.c \
+        asset.cpp \
+        event-loop.cpp \
+        fractional-scale-v1-protocol.c \
+        frame-clock.cpp \
+        frame-timings.cpp \
+        histogram.cpp \
+        log.cpp \
         main.cpp \
         os-compatibility.cpp \
+        paint.cpp \
+        perf-counters.cpp \
+        pixel-kernels.cpp \
+        presentation-time-protocol.c \
+        request-stats.cpp \
+        shm-allocator.cpp \
+        surface-state.cpp \
+        thread-pool.cpp \
+        trace.cpp \
+        viewporter-protocol.c \
         xdg-shell-protocol.c
 
 HEADERS += \
+    alpha-modifier-v1-client-protocol.h \
+    asset.h \
     config.h \
+    event-loop.h \
+    fractional-scale-v1-client-protocol.h \
+    frame-clock.h \
+    frame-timings.h \
+    histogram.h \
+    log.h \
     os-compatibility.h \
+    paint.h \
+    perf-counters.h \
+    pixel-kernels.h \
+    presentation-time-client-protocol.h \
+    probes.h \
+    request-stats.h \
+    shm-allocator.h \
+    surface-state.h \
+    thread-pool.h \
+    trace.h \
+    viewporter-client-protocol.h \
     xdg-shell-client-protocol.h \
     zalloc.h
 
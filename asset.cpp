@@ -0,0 +1,491 @@
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <png.h>
+#include <vector>
+
+#include "asset.h"
+#include "log.h"
+#include "pixel-kernels.h"
+#include "probes.h"
+#include "zalloc.h"
+
+/*
+ * Opaque rectangles smaller than this are not worth a wl_region.add,
+ * and past MAX_OPAQUE_RECTS only the largest ones are kept.  Leaving
+ * opaque pixels out of the region is always safe, the compositor just
+ * blends them.
+ */
+#define MIN_OPAQUE_RECT_AREA 64
+#define MAX_OPAQUE_RECTS 256
+
+/*
+ * The cache is shared by the render threads of every window.  Loads and
+ * lookups are serialized; the assets themselves are immutable.
+ */
+static struct asset*   asset_list  = NULL;
+static pthread_mutex_t asset_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t        cache_hits, cache_misses;
+
+/*
+ * Collect the runs of alpha == 0xff on every row and merge runs with the
+ * same horizontal extent on consecutive rows into rectangles.
+ */
+static void compute_opaque_rects(struct asset* asset)
+{
+    std::vector<struct asset_rect> open, next, done;
+    size_t                          o;
+    int                             x, start;
+
+    for (int y = 0; y <= asset->height; y++)
+    {
+        const uint32_t* row = asset->pixels + y * asset->width;
+
+        next.clear();
+        o = 0;
+        for (x = 0; y < asset->height && x < asset->width;)
+        {
+            if ((row[x] >> 24) != 0xff)
+            {
+                x++;
+                continue;
+            }
+
+            start = x;
+            while (x < asset->width && (row[x] >> 24) == 0xff)
+                x++;
+
+            /* runs are sorted, so the rects still open are too */
+            while (o < open.size() && open[o].x < start)
+                done.push_back(open[o++]);
+
+            if (o < open.size() && open[o].x == start &&
+                open[o].width == x - start)
+            {
+                open[o].height++;
+                next.push_back(open[o++]);
+            }
+            else
+            {
+                next.push_back({start, y, x - start, 1});
+            }
+        }
+        while (o < open.size())
+            done.push_back(open[o++]);
+
+        open.swap(next);
+    }
+
+    done.erase(std::remove_if(done.begin(), done.end(),
+                              [](const struct asset_rect& r) {
+                                  return r.width * r.height <
+                                      MIN_OPAQUE_RECT_AREA;
+                              }),
+               done.end());
+    if (done.size() > MAX_OPAQUE_RECTS)
+    {
+        std::partial_sort(done.begin(), done.begin() + MAX_OPAQUE_RECTS,
+                          done.end(),
+                          [](const struct asset_rect& a,
+                             const struct asset_rect& b) {
+                              return a.width * a.height > b.width * b.height;
+                          });
+        done.resize(MAX_OPAQUE_RECTS);
+    }
+
+    if (done.empty())
+        return;
+
+    asset->opaque_rects =
+        (struct asset_rect*)malloc(done.size() * sizeof(struct asset_rect));
+    if (!asset->opaque_rects)
+        return;
+
+    std::copy(done.begin(), done.end(), asset->opaque_rects);
+    asset->n_opaque_rects = done.size();
+}
+
+static struct asset* load_png(const char* path)
+{
+    struct asset*       asset        = NULL;
+    png_bytep volatile  data         = NULL;
+    png_bytep* volatile row_pointers = NULL;
+    png_structp         pPngPtr;
+    png_infop           pPngInfo;
+    int                 Pngwidth, Pngheight, color_type, bit_depth;
+    size_t              rowbytes;
+
+    // 打开PNG文件
+    FILE* pFile = fopen(path, "rb");
+    if (!pFile)
+    {
+        log_warning("failed to open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    // 创建PNG结构体和信息结构体
+    pPngPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!pPngPtr)
+    {
+        log_error("failed to create the PNG read structure");
+        fclose(pFile);
+        return NULL;
+    }
+
+    pPngInfo = png_create_info_struct(pPngPtr);
+    if (!pPngInfo)
+    {
+        log_error("failed to create the PNG info structure");
+        png_destroy_read_struct(&pPngPtr, NULL, NULL);
+        fclose(pFile);
+        return NULL;
+    }
+
+    // 设置PNG错误处理
+    if (setjmp(png_jmpbuf(pPngPtr)))
+    {
+        log_warning("failed to decode %s", path);
+        free(row_pointers);
+        free(data);
+        png_destroy_read_struct(&pPngPtr, &pPngInfo, NULL);
+        fclose(pFile);
+        return NULL;
+    }
+
+    // 初始化PNG读取
+    png_init_io(pPngPtr, pFile);
+    png_set_sig_bytes(pPngPtr, 0);
+
+    // 读取PNG信息
+    png_read_info(pPngPtr, pPngInfo);
+
+    // 获取PNG图像属性
+    Pngwidth   = png_get_image_width(pPngPtr, pPngInfo);
+    Pngheight  = png_get_image_height(pPngPtr, pPngInfo);
+    color_type = png_get_color_type(pPngPtr, pPngInfo);
+    bit_depth  = png_get_bit_depth(pPngPtr, pPngInfo);
+
+    // 统一转换为 8 位 RGBA
+    if (bit_depth == 16)
+        png_set_strip_16(pPngPtr);
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(pPngPtr);
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+        png_set_expand_gray_1_2_4_to_8(pPngPtr);
+    if (png_get_valid(pPngPtr, pPngInfo, PNG_INFO_tRNS))
+        png_set_tRNS_to_alpha(pPngPtr);
+    else if (!(color_type & PNG_COLOR_MASK_ALPHA))
+        png_set_filler(pPngPtr, 0xff, PNG_FILLER_AFTER);
+    if (color_type == PNG_COLOR_TYPE_GRAY ||
+        color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(pPngPtr);
+    png_read_update_info(pPngPtr, pPngInfo);
+
+    // 为每一行分配内存
+    rowbytes     = png_get_rowbytes(pPngPtr, pPngInfo);
+    data         = (png_bytep)malloc(rowbytes * Pngheight);
+    row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * Pngheight);
+    if (!data || !row_pointers)
+        png_error(pPngPtr, "out of memory");
+    for (int i = 0; i < Pngheight; i++)
+        row_pointers[i] = data + i * rowbytes;
+
+    // 读取PNG像素数据
+    png_read_image(pPngPtr, row_pointers);
+
+    asset = (struct asset*)zalloc(sizeof *asset);
+    if (asset)
+        asset->pixels = (uint32_t*)malloc((size_t)Pngwidth * Pngheight * 4);
+    if (!asset || !asset->pixels)
+    {
+        free(asset);
+        png_error(pPngPtr, "out of memory");
+    }
+
+    asset->path   = strdup(path);
+    asset->scale  = ASSET_SCALE_1;
+    asset->width  = Pngwidth;
+    asset->height = Pngheight;
+    asset->stride = Pngwidth * 4;
+
+    // RGBA 转换为预乘 ARGB8888
+    for (int y = 0; y < Pngheight; y++)
+        pixel_premultiply(asset->pixels + y * Pngwidth, row_pointers[y],
+                          Pngwidth);
+
+    // 释放内存和关闭文件
+    free(row_pointers);
+    free(data);
+    png_destroy_read_struct(&pPngPtr, &pPngInfo, NULL);
+    fclose(pFile);
+
+    compute_opaque_rects(asset);
+
+    return asset;
+}
+
+/*
+ * Filter taps for resampling src pixels to dst along one axis: a tent
+ * that is one source pixel wide when enlarging and one destination pixel
+ * wide when shrinking, so a reduction averages every pixel it covers.
+ * Each destination pixel gets n_taps (index, weight) pairs, the weights
+ * summing to one.
+ */
+static int compute_taps(int                 src,
+                        int                 dst,
+                        std::vector<int>&   index,
+                        std::vector<float>& weight)
+{
+    double ratio  = (double)src / dst;
+    double radius = std::max(ratio, 1.0);
+    int    n_taps = (int)std::ceil(radius) * 2 + 1;
+
+    index.assign((size_t)dst * n_taps, 0);
+    weight.assign((size_t)dst * n_taps, 0.0f);
+
+    for (int i = 0; i < dst; i++)
+    {
+        double center = (i + 0.5) * ratio - 0.5;
+        int    first  = (int)std::floor(center - radius) + 1;
+        double sum    = 0.0;
+
+        for (int t = 0; t < n_taps; t++)
+        {
+            double w = 1.0 - std::fabs(first + t - center) / radius;
+
+            index[i * n_taps + t]  = std::min(std::max(first + t, 0), src - 1);
+            weight[i * n_taps + t] = w > 0.0 ? w : 0.0;
+            sum += weight[i * n_taps + t];
+        }
+        for (int t = 0; t < n_taps; t++)
+            weight[i * n_taps + t] /= sum;
+    }
+
+    return n_taps;
+}
+
+/*
+ * Resample the decoded image to scale.  Premultiplied pixels can be
+ * filtered channel by channel without fringes.
+ */
+static struct asset* scale_asset(const struct asset* src, int32_t scale)
+{
+    std::vector<int>   x_index, y_index;
+    std::vector<float> x_weight, y_weight, rows;
+    struct asset*      asset;
+    int                width, height, x_taps, y_taps;
+
+    width  = std::max(asset_scale_length(src->width, scale), 1);
+    height = std::max(asset_scale_length(src->height, scale), 1);
+
+    asset = (struct asset*)zalloc(sizeof *asset);
+    if (!asset)
+        return NULL;
+
+    asset->pixels = (uint32_t*)malloc((size_t)width * height * 4);
+    asset->path   = strdup(src->path);
+    if (!asset->pixels || !asset->path)
+    {
+        free(asset->pixels);
+        free(asset->path);
+        free(asset);
+        return NULL;
+    }
+
+    asset->scale  = scale;
+    asset->width  = width;
+    asset->height = height;
+    asset->stride = width * 4;
+
+    x_taps = compute_taps(src->width, width, x_index, x_weight);
+    y_taps = compute_taps(src->height, height, y_index, y_weight);
+
+    /* Horizontal pass into float rows, then vertical into the asset. */
+    rows.resize((size_t)src->height * width * 4);
+    for (int y = 0; y < src->height; y++)
+    {
+        const uint32_t* in  = src->pixels + (size_t)y * src->width;
+        float*          out = &rows[(size_t)y * width * 4];
+
+        for (int x = 0; x < width; x++, out += 4)
+        {
+            float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+            for (int t = 0; t < x_taps; t++)
+            {
+                uint32_t p = in[x_index[x * x_taps + t]];
+                float    w = x_weight[x * x_taps + t];
+
+                for (int c = 0; c < 4; c++)
+                    acc[c] += w * ((p >> (c * 8)) & 0xff);
+            }
+            memcpy(out, acc, sizeof acc);
+        }
+    }
+
+    for (int y = 0; y < height; y++)
+    {
+        uint32_t* out = asset->pixels + (size_t)y * width;
+
+        for (int x = 0; x < width; x++)
+        {
+            float    acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            uint32_t p      = 0;
+
+            for (int t = 0; t < y_taps; t++)
+            {
+                const float* in =
+                    &rows[((size_t)y_index[y * y_taps + t] * width + x) * 4];
+                float w = y_weight[y * y_taps + t];
+
+                for (int c = 0; c < 4; c++)
+                    acc[c] += w * in[c];
+            }
+            for (int c = 0; c < 4; c++)
+                p |= (uint32_t)std::min(std::max(acc[c] + 0.5f, 0.0f),
+                                        255.0f)
+                    << (c * 8);
+            out[x] = p;
+        }
+    }
+
+    compute_opaque_rects(asset);
+
+    return asset;
+}
+
+static struct asset* asset_cache_find(const char* path, int32_t scale)
+{
+    struct asset* asset;
+
+    for (asset = asset_list; asset; asset = asset->next)
+        if (asset->scale == scale && strcmp(asset->path, path) == 0)
+            return asset;
+
+    return NULL;
+}
+
+static struct asset* asset_cache_load(const char* path)
+{
+    struct asset* asset;
+
+    asset = asset_cache_find(path, ASSET_SCALE_1);
+    if (asset)
+        return asset;
+
+    asset = load_png(path);
+    if (!asset)
+    {
+        PROBE1(asset_load_fail, path);
+        return NULL;
+    }
+    PROBE3(asset_load, path, asset->width, asset->height);
+
+    asset->next = asset_list;
+    asset_list  = asset;
+
+    return asset;
+}
+
+/*
+ * Look up a decoded image, decoding it on first use.  A failed load is
+ * not cached, so a missing file is retried the next time it is asked for.
+ */
+struct asset* asset_cache_get(const char* path)
+{
+    struct asset* asset;
+
+    pthread_mutex_lock(&asset_mutex);
+    asset = asset_cache_find(path, ASSET_SCALE_1);
+    if (asset)
+    {
+        cache_hits++;
+    }
+    else
+    {
+        cache_misses++;
+        asset = asset_cache_load(path);
+    }
+    pthread_mutex_unlock(&asset_mutex);
+
+    return asset;
+}
+
+/*
+ * The image at a buffer scale, resampled from the decoded one the first
+ * time the scale is asked for.
+ */
+struct asset* asset_cache_get_scaled(const char* path, int32_t scale)
+{
+    struct asset *asset, *base;
+
+    pthread_mutex_lock(&asset_mutex);
+
+    asset = asset_cache_find(path, scale);
+    if (asset)
+    {
+        cache_hits++;
+    }
+    else
+    {
+        cache_misses++;
+        base = asset_cache_load(path);
+        if (base && scale != ASSET_SCALE_1)
+        {
+            asset = scale_asset(base, scale);
+            if (asset)
+            {
+                asset->next = asset_list;
+                asset_list  = asset;
+            }
+        }
+        else
+        {
+            asset = base;
+        }
+    }
+
+    pthread_mutex_unlock(&asset_mutex);
+
+    return asset;
+}
+
+void asset_cache_get_stats(struct asset_cache_stats* stats)
+{
+    struct asset* asset;
+
+    pthread_mutex_lock(&asset_mutex);
+    stats->count  = 0;
+    stats->bytes  = 0;
+    stats->hits   = cache_hits;
+    stats->misses = cache_misses;
+    for (asset = asset_list; asset; asset = asset->next)
+    {
+        stats->count++;
+        stats->bytes += (size_t)asset->stride * asset->height;
+    }
+    pthread_mutex_unlock(&asset_mutex);
+}
+
+void asset_cache_clear(void)
+{
+    struct asset* asset;
+
+    while ((asset = asset_list))
+    {
+        asset_list = asset->next;
+        free(asset->opaque_rects);
+        free(asset->pixels);
+        free(asset->path);
+        free(asset);
+    }
+}
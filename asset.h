@@ -0,0 +1,65 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Scales are in 120ths, the unit of wp_fractional_scale_v1. */
+#define ASSET_SCALE_1 120
+
+struct asset_rect
+{
+    int x, y, width, height;
+};
+
+/*
+ * A decoded watermark image.
+ *
+ * Pixels are kept as premultiplied ARGB8888, the layout wl_shm expects,
+ * so painting an asset is a plain copy into the shm buffer.  Assets are
+ * owned by the cache and stay valid until asset_cache_clear().
+ *
+ * The fully opaque parts of the image are computed once at decode time
+ * and kept as a list of rectangles, ready to be fed to a wl_region.
+ *
+ * Besides the decoded image at ASSET_SCALE_1 the cache holds one copy per
+ * buffer scale it was asked for, resampled to the device-pixel size.
+ * Each copy has opaque rectangles of its own, in its device pixels: the
+ * filter blends the edges of the opaque parts with their neighbours, so
+ * those of the decoded image would claim pixels that are not opaque.
+ */
+struct asset
+{
+    char*              path;
+    int32_t            scale;
+    int                width, height;
+    int                stride;
+    uint32_t*          pixels;
+    struct asset_rect* opaque_rects;
+    int                n_opaque_rects;
+    struct asset*      next;
+};
+
+/* What the cache holds and how often lookups found what they wanted. */
+struct asset_cache_stats
+{
+    int      count;
+    size_t   bytes;
+    uint64_t hits, misses;
+};
+
+struct asset* asset_cache_get(const char* path);
+
+struct asset* asset_cache_get_scaled(const char* path, int32_t scale);
+
+/* The device-pixel length of a surface-local length at scale. */
+static inline int asset_scale_length(int length, int32_t scale)
+{
+    return (length * scale + ASSET_SCALE_1 / 2) / ASSET_SCALE_1;
+}
+
+void asset_cache_get_stats(struct asset_cache_stats* stats);
+
+void asset_cache_clear(void);
+
+#endif /* ASSET_H */
@@ -0,0 +1,132 @@
+/*
+ * Clear throughput: the per-pixel loop paint_pixels() used to run,
+ * memset, and the cached and streaming fill kernels, from a small rect
+ * up to an 8K surface.  Every result is the median of the runs.
+ *
+ * Usage: fill [ITERATIONS]
+ */
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "clock.h"
+#include "pixel-kernels.h"
+
+struct size
+{
+    const char* name;
+    int         width, height;
+};
+
+static const struct size sizes[] = {
+    {"256x256", 256, 256},
+    {"1080p", 1920, 1080},
+    {"4K", 3840, 2160},
+    {"8K", 7680, 4320},
+};
+
+/* Read at run time, so the loop below is not turned into a memset. */
+static volatile uint32_t clear_value = 0;
+
+static void fill_loop(uint32_t* pixel, int width, int height)
+{
+    uint32_t value = clear_value;
+
+    for (int h = 0; h < height; h++)
+    {
+        for (int w = 0; w < width; w++)
+        {
+            *pixel++ = value;
+        }
+    }
+}
+
+static void fill_memset(uint32_t* pixel, int width, int height)
+{
+    memset(pixel, 0, (size_t)width * height * 4);
+}
+
+static void fill_cached(uint32_t* pixel, int width, int height)
+{
+    pixel_fill(pixel, clear_value, (size_t)width * height);
+}
+
+static void fill_stream(uint32_t* pixel, int width, int height)
+{
+    pixel_fill_stream(pixel, clear_value, (size_t)width * height);
+}
+
+static double run(void (*fill)(uint32_t*, int, int),
+                  uint32_t*          pixels,
+                  const struct size* size,
+                  int                iterations)
+{
+    std::vector<uint64_t> samples;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = clock_now_ns();
+
+        fill(pixels, size->width, size->height);
+        samples.push_back(clock_now_ns() - start);
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    return samples[samples.size() / 2] / 1e6;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct
+    {
+        const char* name;
+        void (*fill)(uint32_t*, int, int);
+    } kernels[] = {
+        {"loop", fill_loop},
+        {"memset", fill_memset},
+        {"pixel_fill", fill_cached},
+        {"pixel_fill_stream", fill_stream},
+    };
+    int iterations = argc > 1 ? atoi(argv[1]) : 30;
+
+    printf("last level cache %zu KiB, %d iterations\n",
+           pixel_cache_size() >> 10, iterations);
+    printf("%-8s %-18s %10s %10s\n", "size", "kernel", "median ms", "GB/s");
+
+    for (const struct size& size : sizes)
+    {
+        size_t    bytes = (size_t)size.width * size.height * 4;
+        uint32_t* pixels;
+
+        pixels = (uint32_t*)mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pixels == MAP_FAILED)
+        {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        /* fault the pages in before timing anything */
+        memset(pixels, 0xff, bytes);
+
+        for (const auto& kernel : kernels)
+        {
+            double ms = run(kernel.fill, pixels, &size, iterations);
+
+            printf("%-8s %-18s %10.3f %10.2f\n", size.name, kernel.name, ms,
+                   bytes / ms / 1e6);
+        }
+
+        munmap(pixels, bytes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * Microbenchmarks for the per-frame pixel work and for getting a fresh
+ * shm buffer, at the surface sizes a window is likely to have.  Prints
+ * one JSON document to stdout.
+ *
+ * Kernels report the median run as ns per pixel and as GB/s, counting
+ * every byte read and written once.  Allocations report latency
+ * percentiles: os_create_anonymous_file() alone, and a whole buffer the
+ * way shm_allocator_create() makes one, file and mapping, with every
+ * page faulted in by a first paint.  The wl_shm requests themselves
+ * need a compositor and are left out.
+ *
+ * Usage: micro [ITERATIONS]
+ *
+ * Without memfd_create() anonymous files live in XDG_RUNTIME_DIR, which
+ * then has to be set, as it has for the client itself.
+ */
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "asset.h"
+#include "clock.h"
+#include "histogram.h"
+#include "os-compatibility.h"
+#include "paint.h"
+#include "pixel-kernels.h"
+
+#define TILE_SIZE 256
+
+struct size
+{
+    const char* name;
+    int         width, height;
+};
+
+static const struct size sizes[] = {
+    {"720p", 1280, 720},
+    {"1080p", 1920, 1080},
+    {"4K", 3840, 2160},
+    {"8K", 7680, 4320},
+};
+
+/* What a kernel works on; every buffer holds a whole surface. */
+struct surface
+{
+    const struct size*  size;
+    uint32_t*           dst;
+    uint32_t*           src;
+    uint8_t*            rgba;
+    struct paint_layer* tiles;
+    int                 n_tiles;
+};
+
+static size_t pixel_count(const struct surface* s)
+{
+    return (size_t)s->size->width * s->size->height;
+}
+
+static void clear(struct surface* s)
+{
+    pixel_fill(s->dst, 0x00000000, pixel_count(s));
+}
+
+static void clear_stream(struct surface* s)
+{
+    pixel_fill_stream(s->dst, 0x00000000, pixel_count(s));
+}
+
+/* A decoded PNG into the asset layout, row by row as load_png() does. */
+static void convert(struct surface* s)
+{
+    int width = s->size->width;
+
+    for (int y = 0; y < s->size->height; y++)
+        pixel_premultiply(s->dst + (size_t)y * width,
+                          s->rgba + (size_t)y * width * 4, width);
+}
+
+static void blend(struct surface* s)
+{
+    int width = s->size->width;
+
+    for (int y = 0; y < s->size->height; y++)
+        pixel_scale_alpha(s->dst + (size_t)y * width,
+                          s->src + (size_t)y * width, width, 200);
+}
+
+static void blit(struct surface* s)
+{
+    int width = s->size->width;
+
+    for (int y = 0; y < s->size->height; y++)
+        pixel_scale_alpha(s->dst + (size_t)y * width,
+                          s->src + (size_t)y * width, width, 255);
+}
+
+/* The surface covered in images, painted as paint_surface() does. */
+static void tile(struct surface* s)
+{
+    paint_surface(NULL, s->dst, s->size->width, s->size->height, s->tiles,
+                  s->n_tiles, 200, NULL);
+}
+
+static const struct
+{
+    const char* name;
+    void (*run)(struct surface*);
+    int bytes_per_pixel;
+} kernels[] = {
+    {"clear", clear, 4},
+    {"clear_stream", clear_stream, 4},
+    {"convert", convert, 8},
+    {"blend", blend, 8},
+    {"blit", blit, 8},
+    {"tile", tile, 12},
+};
+
+static void* map_pixels(size_t bytes)
+{
+    void* data = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /* fault the pages in before timing anything */
+    memset(data, 0x7f, bytes);
+
+    return data;
+}
+
+static void make_tiles(struct surface* s, struct asset* asset)
+{
+    int columns = (s->size->width + TILE_SIZE - 1) / TILE_SIZE;
+    int rows    = (s->size->height + TILE_SIZE - 1) / TILE_SIZE;
+
+    memset(asset, 0, sizeof *asset);
+    asset->width  = TILE_SIZE;
+    asset->height = TILE_SIZE;
+    asset->stride = TILE_SIZE * 4;
+    asset->pixels = s->src;
+
+    s->n_tiles = columns * rows;
+    s->tiles   = new struct paint_layer[s->n_tiles];
+    for (int i = 0; i < s->n_tiles; i++)
+        s->tiles[i] = {asset, i % columns * TILE_SIZE,
+                       i / columns * TILE_SIZE};
+}
+
+static void bench_kernels(const struct size* size, int iterations, bool* first)
+{
+    struct surface s;
+    struct asset   asset;
+    size_t         bytes = (size_t)size->width * size->height * 4;
+
+    s.size = size;
+    s.dst  = (uint32_t*)map_pixels(bytes);
+    s.src  = (uint32_t*)map_pixels(bytes);
+    s.rgba = (uint8_t*)map_pixels(bytes);
+    make_tiles(&s, &asset);
+
+    for (const auto& kernel : kernels)
+    {
+        std::vector<uint64_t> samples;
+        double                ns;
+
+        for (int i = 0; i < iterations; i++)
+        {
+            uint64_t start = clock_now_ns();
+
+            kernel.run(&s);
+            samples.push_back(clock_now_ns() - start);
+        }
+
+        std::sort(samples.begin(), samples.end());
+        ns = samples[samples.size() / 2];
+
+        printf("%s\n    {\"kernel\": \"%s\", \"size\": \"%s\", "
+               "\"width\": %d, \"height\": %d, \"median_ns\": %.0f, "
+               "\"ns_per_pixel\": %.4f, \"gb_per_s\": %.2f}",
+               *first ? "" : ",", kernel.name, size->name, size->width,
+               size->height, ns, ns / pixel_count(&s),
+               pixel_count(&s) * kernel.bytes_per_pixel / ns);
+        *first = false;
+    }
+
+    delete[] s.tiles;
+    munmap(s.dst, bytes);
+    munmap(s.src, bytes);
+    munmap(s.rgba, bytes);
+}
+
+/* Time to the descriptor; the file is closed outside the clock. */
+static uint64_t create_file(size_t bytes)
+{
+    uint64_t start = clock_now_ns();
+    int      fd    = os_create_anonymous_file(bytes);
+    uint64_t ns    = clock_now_ns() - start;
+
+    if (fd < 0)
+    {
+        perror("os_create_anonymous_file");
+        exit(1);
+    }
+    close(fd);
+
+    return ns;
+}
+
+/* Time to a buffer the first frame has written all of. */
+static uint64_t create_buffer(size_t bytes)
+{
+    size_t   page  = sysconf(_SC_PAGESIZE);
+    uint64_t start = clock_now_ns(), ns;
+    char*    data;
+    int      fd;
+
+    fd = os_create_anonymous_file(bytes);
+    if (fd < 0)
+    {
+        perror("os_create_anonymous_file");
+        exit(1);
+    }
+
+    data = (char*)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       0);
+    if (data == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+
+    for (size_t offset = 0; offset < bytes; offset += page)
+        data[offset] = 0;
+    ns = clock_now_ns() - start;
+
+    munmap(data, bytes);
+    close(fd);
+
+    return ns;
+}
+
+static void bench_allocation(const struct size* size,
+                             int                iterations,
+                             bool*              first)
+{
+    static const struct
+    {
+        const char* name;
+        uint64_t (*run)(size_t);
+    } ops[] = {
+        {"os_create_anonymous_file", create_file},
+        {"shm_buffer", create_buffer},
+    };
+    size_t bytes = (size_t)size->width * size->height * 4;
+
+    for (const auto& op : ops)
+    {
+        struct histogram h;
+
+        histogram_init(&h);
+        for (int i = 0; i < iterations; i++)
+            histogram_record(&h, op.run(bytes));
+
+        printf("%s\n    {\"op\": \"%s\", \"size\": \"%s\", \"bytes\": %zu, "
+               "\"count\": %" PRIu64 ", \"mean_ns\": %.0f, "
+               "\"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64
+               ", \"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 "}",
+               *first ? "" : ",", op.name, size->name, bytes, h.count,
+               histogram_mean(&h), histogram_percentile(&h, 50),
+               histogram_percentile(&h, 90), histogram_percentile(&h, 99),
+               h.max);
+        *first = false;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int  iterations = argc > 1 ? atoi(argv[1]) : 30;
+    bool first;
+
+    if (iterations < 1)
+        iterations = 1;
+
+    printf("{\"iterations\": %d, \"cache_bytes\": %zu,\n", iterations,
+           pixel_cache_size());
+
+    printf(" \"kernels\": [");
+    first = true;
+    for (const struct size& size : sizes)
+        bench_kernels(&size, iterations, &first);
+    printf("],\n");
+
+    /* allocations are cheap next to a frame, take more of them */
+    printf(" \"allocation\": [");
+    first = true;
+    for (const struct size& size : sizes)
+        bench_allocation(&size, iterations * 10, &first);
+    printf("]}\n");
+
+    return 0;
+}
@@ -0,0 +1,939 @@
+/*
+ * A compositor that shows nothing, for end-to-end runs without a
+ * display or a GPU.
+ *
+ * It offers wl_compositor, wl_shm, xdg_wm_base and one wl_output, and
+ * starts the client itself on a socket pair (WAYLAND_SOCKET), so runs do
+ * not depend on a session.  A timerfd stands in for vblank: on every
+ * refresh the frame callbacks committed since the last one are done and,
+ * by default, the buffers shown are released, as a compositor that
+ * copies shm buffers at repaint would.  With --keep a buffer is held
+ * until the next one replaces it, as with direct scanout.
+ *
+ * Every committed buffer is read back through libwayland-server's shm
+ * mapping and checksummed, which also costs the client's pages the
+ * faults a real compositor's upload would.
+ *
+ * After the run the client gets SIGTERM and one JSON document goes to
+ * stdout: frames shown per second, time from a frame callback to the
+ * commit answering it, time from a commit to the buffer's release, and
+ * the checksums of what each surface showed last.
+ *
+ * Usage: mock-compositor [-r HZ] [-d SECONDS] [-k] -- CLIENT [ARGS...]
+ *
+ * The client still needs XDG_RUNTIME_DIR for its shm files where there
+ * is no memfd_create().
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <wayland-server.h>
+
+#include "clock.h"
+#include "histogram.h"
+#include "os-compatibility.h"
+#include "xdg-shell-server-protocol.h"
+#include "zalloc.h"
+
+#define OUTPUT_WIDTH 1920
+#define OUTPUT_HEIGHT 1080
+
+/* How long the client gets to exit after SIGTERM before SIGKILL. */
+#define KILL_TIMEOUT_MS 5000
+
+#define SURFACE(resource)                                                     \
+    ((struct surface*)wl_resource_get_user_data(resource))
+
+/* A buffer reference that notices the client destroying the buffer. */
+struct buffer_ref
+{
+    struct wl_resource* resource;
+    struct wl_listener  destroy;
+    uint64_t            commit_ns;
+};
+
+struct surface
+{
+    struct wl_resource* resource;
+    struct wl_resource* xdg_surface;
+    struct wl_resource* toplevel;
+    bool                configured;
+
+    /* Double-buffered state, applied on commit. */
+    struct buffer_ref pending;
+    bool              attached;
+    struct wl_list    pending_callbacks;
+
+    /* The buffer shown and not yet released, and who waits on it. */
+    struct buffer_ref held;
+    struct wl_list    callbacks;
+    bool              updated;
+    bool              committed;
+    uint64_t          checksum;
+    uint64_t          done_ns;
+
+    struct wl_list link;
+};
+
+static struct
+{
+    struct wl_display*      display;
+    struct wl_client*       client;
+    struct wl_listener      client_destroy;
+    struct wl_event_source* refresh;
+    struct wl_event_source* deadline;
+    struct wl_list          surfaces;
+    pid_t                   pid;
+    int                     refresh_mhz;
+    bool                    keep;
+    bool                    terminated;
+
+    uint64_t         start_ns, end_ns;
+    uint64_t         commits, buffer_commits;
+    uint64_t         frames, replaced, repeated;
+    uint64_t         acks, missed_refreshes;
+    struct histogram frame_to_commit;
+    struct histogram commit_to_release;
+    int              status;
+
+    /* What every surface showed last, in the order they went away. */
+    std::vector<uint64_t> checksums;
+} compositor;
+
+static void buffer_ref_destroyed(struct wl_listener* listener, void* data)
+{
+    struct buffer_ref* ref = wl_container_of(listener, ref, destroy);
+
+    ref->resource = NULL;
+    wl_list_remove(&ref->destroy.link);
+    wl_list_init(&ref->destroy.link);
+}
+
+static void buffer_ref_set(struct buffer_ref* ref, struct wl_resource* buffer)
+{
+    if (ref->resource)
+        wl_list_remove(&ref->destroy.link);
+
+    ref->resource = buffer;
+    if (buffer)
+    {
+        ref->destroy.notify = buffer_ref_destroyed;
+        wl_resource_add_destroy_listener(buffer, &ref->destroy);
+    }
+}
+
+/* Hand the held buffer back to the client. */
+static void surface_release(struct surface* surface)
+{
+    struct buffer_ref* held = &surface->held;
+
+    if (!held->resource)
+        return;
+
+    wl_buffer_send_release(held->resource);
+    histogram_record(&compositor.commit_to_release,
+                     clock_now_ns() - held->commit_ns);
+    buffer_ref_set(held, NULL);
+}
+
+/* FNV-1a over 64-bit words, row by row; padding is left out. */
+static uint64_t checksum_buffer(struct wl_resource* buffer)
+{
+    struct wl_shm_buffer* shm = wl_shm_buffer_get(buffer);
+    const uint8_t*        data;
+    uint64_t              hash = 0xcbf29ce484222325ull;
+    int32_t               stride, width, height;
+
+    if (!shm)
+        return 0;
+
+    stride = wl_shm_buffer_get_stride(shm);
+    width  = wl_shm_buffer_get_width(shm);
+    height = wl_shm_buffer_get_height(shm);
+
+    wl_shm_buffer_begin_access(shm);
+    data = (const uint8_t*)wl_shm_buffer_get_data(shm);
+    for (int32_t y = 0; y < height; y++)
+    {
+        const uint8_t* row = data + (size_t)y * stride;
+        int32_t        x   = 0;
+        uint64_t       word;
+
+        for (; x + 2 <= width; x += 2)
+        {
+            memcpy(&word, row + x * 4, sizeof word);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+        if (x < width)
+        {
+            word = 0;
+            memcpy(&word, row + x * 4, 4);
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+    }
+    wl_shm_buffer_end_access(shm);
+
+    return hash;
+}
+
+static void callback_destroy(struct wl_resource* resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void region_destroy(struct wl_client*   client,
+                           struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void region_add(struct wl_client*   client,
+                       struct wl_resource* resource,
+                       int32_t             x,
+                       int32_t             y,
+                       int32_t             width,
+                       int32_t             height)
+{
+}
+
+static const struct wl_region_interface region_implementation = {
+    region_destroy, region_add, region_add};
+
+static void surface_destroy(struct wl_client*   client,
+                            struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void surface_attach(struct wl_client*   client,
+                           struct wl_resource* resource,
+                           struct wl_resource* buffer,
+                           int32_t             x,
+                           int32_t             y)
+{
+    struct surface* surface = SURFACE(resource);
+
+    buffer_ref_set(&surface->pending, buffer);
+    surface->attached = true;
+}
+
+static void surface_damage(struct wl_client*   client,
+                           struct wl_resource* resource,
+                           int32_t             x,
+                           int32_t             y,
+                           int32_t             width,
+                           int32_t             height)
+{
+}
+
+static void surface_frame(struct wl_client*   client,
+                          struct wl_resource* resource,
+                          uint32_t            id)
+{
+    struct surface*     surface = SURFACE(resource);
+    struct wl_resource* callback;
+
+    callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+    if (!callback)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(callback, NULL, NULL, callback_destroy);
+    wl_list_insert(surface->pending_callbacks.prev,
+                   wl_resource_get_link(callback));
+}
+
+static void surface_set_region(struct wl_client*   client,
+                               struct wl_resource* resource,
+                               struct wl_resource* region)
+{
+}
+
+/* xdg-shell: the first commit of a toplevel is answered by a configure. */
+static void surface_configure(struct surface* surface)
+{
+    struct wl_array states;
+
+    wl_array_init(&states);
+    xdg_toplevel_send_configure(surface->toplevel, 0, 0, &states);
+    wl_array_release(&states);
+
+    xdg_surface_send_configure(surface->xdg_surface,
+                               wl_display_next_serial(compositor.display));
+    surface->configured = true;
+}
+
+static void surface_commit_buffer(struct surface* surface)
+{
+    struct wl_resource* buffer = surface->pending.resource;
+    uint64_t            now    = clock_now_ns();
+    uint64_t            checksum;
+
+    compositor.buffer_commits++;
+    if (!compositor.start_ns)
+        compositor.start_ns = now;
+    if (surface->done_ns)
+    {
+        histogram_record(&compositor.frame_to_commit,
+                         now - surface->done_ns);
+        surface->done_ns = 0;
+    }
+
+    /* a buffer replaced before any refresh showed it is a lost frame */
+    if (surface->held.resource && surface->held.resource != buffer)
+    {
+        compositor.replaced += surface->updated;
+        surface_release(surface);
+    }
+
+    checksum = checksum_buffer(buffer);
+    if (surface->committed && checksum == surface->checksum)
+        compositor.repeated++;
+    surface->checksum  = checksum;
+    surface->committed = true;
+    surface->updated   = true;
+
+    buffer_ref_set(&surface->held, buffer);
+    surface->held.commit_ns = now;
+}
+
+static void surface_commit(struct wl_client*   client,
+                           struct wl_resource* resource)
+{
+    struct surface* surface = SURFACE(resource);
+
+    compositor.commits++;
+
+    if (surface->toplevel && !surface->configured)
+    {
+        surface_configure(surface);
+        return;
+    }
+
+    if (surface->attached && surface->pending.resource)
+        surface_commit_buffer(surface);
+    else if (surface->attached)
+        surface_release(surface);
+    surface->attached = false;
+    buffer_ref_set(&surface->pending, NULL);
+
+    wl_list_insert_list(surface->callbacks.prev,
+                        &surface->pending_callbacks);
+    wl_list_init(&surface->pending_callbacks);
+}
+
+static void surface_set_int(struct wl_client*   client,
+                            struct wl_resource* resource,
+                            int32_t             value)
+{
+}
+
+static const struct wl_surface_interface surface_implementation = {
+    surface_destroy,    surface_attach,     surface_damage,
+    surface_frame,      surface_set_region, surface_set_region,
+    surface_commit,     surface_set_int,    surface_set_int,
+    surface_damage};
+
+/* Callbacks outlive the surface, they are simply never done. */
+static void surface_resource_destroy(struct wl_resource* resource)
+{
+    struct surface*     surface = SURFACE(resource);
+    struct wl_resource *callback, *next;
+
+    wl_resource_for_each_safe(callback, next, &surface->pending_callbacks)
+    {
+        wl_list_remove(wl_resource_get_link(callback));
+        wl_list_init(wl_resource_get_link(callback));
+    }
+    wl_resource_for_each_safe(callback, next, &surface->callbacks)
+    {
+        wl_list_remove(wl_resource_get_link(callback));
+        wl_list_init(wl_resource_get_link(callback));
+    }
+
+    /* the shell objects may outlive the surface, if only in teardown */
+    if (surface->xdg_surface)
+        wl_resource_set_user_data(surface->xdg_surface, NULL);
+    if (surface->toplevel)
+        wl_resource_set_user_data(surface->toplevel, NULL);
+
+    if (surface->committed)
+        compositor.checksums.push_back(surface->checksum);
+    buffer_ref_set(&surface->pending, NULL);
+    buffer_ref_set(&surface->held, NULL);
+    wl_list_remove(&surface->link);
+    free(surface);
+}
+
+static void compositor_create_surface(struct wl_client*   client,
+                                      struct wl_resource* resource,
+                                      uint32_t            id)
+{
+    struct surface* surface;
+
+    surface = (struct surface*)zalloc(sizeof *surface);
+    if (surface)
+        surface->resource =
+            wl_resource_create(client, &wl_surface_interface,
+                               wl_resource_get_version(resource), id);
+    if (!surface || !surface->resource)
+    {
+        free(surface);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_list_init(&surface->pending.destroy.link);
+    wl_list_init(&surface->held.destroy.link);
+    wl_list_init(&surface->pending_callbacks);
+    wl_list_init(&surface->callbacks);
+    wl_list_insert(compositor.surfaces.prev, &surface->link);
+    wl_resource_set_implementation(surface->resource, &surface_implementation,
+                                   surface, surface_resource_destroy);
+}
+
+static void compositor_create_region(struct wl_client*   client,
+                                     struct wl_resource* resource,
+                                     uint32_t            id)
+{
+    struct wl_resource* region;
+
+    region = wl_resource_create(client, &wl_region_interface, 1, id);
+    if (!region)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(region, &region_implementation, NULL,
+                                   NULL);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+    compositor_create_surface, compositor_create_region};
+
+static void
+bind_compositor(struct wl_client* client, void* data, uint32_t version,
+                uint32_t id)
+{
+    struct wl_resource* resource;
+
+    resource = wl_resource_create(client, &wl_compositor_interface, version,
+                                  id);
+    if (!resource)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &compositor_implementation,
+                                   NULL, NULL);
+}
+
+static void toplevel_destroy(struct wl_client*   client,
+                             struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void toplevel_set_resource(struct wl_client*   client,
+                                  struct wl_resource* resource,
+                                  struct wl_resource* other)
+{
+}
+
+static void toplevel_set_string(struct wl_client*   client,
+                                struct wl_resource* resource,
+                                const char*         string)
+{
+}
+
+static void toplevel_show_window_menu(struct wl_client*   client,
+                                      struct wl_resource* resource,
+                                      struct wl_resource* seat,
+                                      uint32_t            serial,
+                                      int32_t             x,
+                                      int32_t             y)
+{
+}
+
+static void toplevel_move(struct wl_client*   client,
+                          struct wl_resource* resource,
+                          struct wl_resource* seat,
+                          uint32_t            serial)
+{
+}
+
+static void toplevel_resize(struct wl_client*   client,
+                            struct wl_resource* resource,
+                            struct wl_resource* seat,
+                            uint32_t            serial,
+                            uint32_t            edges)
+{
+}
+
+static void toplevel_set_size(struct wl_client*   client,
+                              struct wl_resource* resource,
+                              int32_t             width,
+                              int32_t             height)
+{
+}
+
+static void toplevel_set_state(struct wl_client*   client,
+                               struct wl_resource* resource)
+{
+}
+
+/* set_parent and set_fullscreen take a resource, the rest are states. */
+static const struct xdg_toplevel_interface toplevel_implementation = {
+    toplevel_destroy,
+    toplevel_set_resource,
+    toplevel_set_string,
+    toplevel_set_string,
+    toplevel_show_window_menu,
+    toplevel_move,
+    toplevel_resize,
+    toplevel_set_size,
+    toplevel_set_size,
+    toplevel_set_state,
+    toplevel_set_state,
+    toplevel_set_resource,
+    toplevel_set_state,
+    toplevel_set_state};
+
+static void toplevel_resource_destroy(struct wl_resource* resource)
+{
+    struct surface* surface = SURFACE(resource);
+
+    if (surface)
+        surface->toplevel = NULL;
+}
+
+static void xdg_surface_destroy(struct wl_client*   client,
+                                struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void xdg_surface_get_toplevel(struct wl_client*   client,
+                                     struct wl_resource* resource,
+                                     uint32_t            id)
+{
+    struct surface* surface = SURFACE(resource);
+
+    if (!surface)
+    {
+        wl_resource_post_error(resource, XDG_SURFACE_ERROR_NOT_CONSTRUCTED,
+                               "the wl_surface is gone");
+        return;
+    }
+
+    surface->toplevel = wl_resource_create(client, &xdg_toplevel_interface,
+                                           wl_resource_get_version(resource),
+                                           id);
+    if (!surface->toplevel)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(surface->toplevel, &toplevel_implementation,
+                                   surface, toplevel_resource_destroy);
+}
+
+static void xdg_surface_get_popup(struct wl_client*   client,
+                                  struct wl_resource* resource,
+                                  uint32_t            id,
+                                  struct wl_resource* parent,
+                                  struct wl_resource* positioner)
+{
+    wl_resource_post_error(resource, XDG_WM_BASE_ERROR_INVALID_POSITIONER,
+                           "popups are not supported");
+}
+
+static void xdg_surface_set_window_geometry(struct wl_client*   client,
+                                            struct wl_resource* resource,
+                                            int32_t             x,
+                                            int32_t             y,
+                                            int32_t             width,
+                                            int32_t             height)
+{
+}
+
+static void xdg_surface_ack_configure(struct wl_client*   client,
+                                      struct wl_resource* resource,
+                                      uint32_t            serial)
+{
+    compositor.acks++;
+}
+
+static const struct xdg_surface_interface xdg_surface_implementation = {
+    xdg_surface_destroy, xdg_surface_get_toplevel, xdg_surface_get_popup,
+    xdg_surface_set_window_geometry, xdg_surface_ack_configure};
+
+static void xdg_surface_resource_destroy(struct wl_resource* resource)
+{
+    struct surface* surface = SURFACE(resource);
+
+    if (surface)
+        surface->xdg_surface = NULL;
+}
+
+static void wm_base_destroy(struct wl_client*   client,
+                            struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void wm_base_create_positioner(struct wl_client*   client,
+                                      struct wl_resource* resource,
+                                      uint32_t            id)
+{
+    wl_resource_post_error(resource, XDG_WM_BASE_ERROR_INVALID_POSITIONER,
+                           "positioners are not supported");
+}
+
+static void wm_base_get_xdg_surface(struct wl_client*   client,
+                                    struct wl_resource* resource,
+                                    uint32_t            id,
+                                    struct wl_resource* surface_resource)
+{
+    struct surface* surface = SURFACE(surface_resource);
+
+    surface->xdg_surface =
+        wl_resource_create(client, &xdg_surface_interface,
+                           wl_resource_get_version(resource), id);
+    if (!surface->xdg_surface)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(surface->xdg_surface,
+                                   &xdg_surface_implementation, surface,
+                                   xdg_surface_resource_destroy);
+}
+
+static void wm_base_pong(struct wl_client*   client,
+                         struct wl_resource* resource,
+                         uint32_t            serial)
+{
+}
+
+static const struct xdg_wm_base_interface wm_base_implementation = {
+    wm_base_destroy, wm_base_create_positioner, wm_base_get_xdg_surface,
+    wm_base_pong};
+
+static void
+bind_wm_base(struct wl_client* client, void* data, uint32_t version,
+             uint32_t id)
+{
+    struct wl_resource* resource;
+
+    resource = wl_resource_create(client, &xdg_wm_base_interface, version, id);
+    if (!resource)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &wm_base_implementation, NULL,
+                                   NULL);
+}
+
+static void
+bind_output(struct wl_client* client, void* data, uint32_t version,
+            uint32_t id)
+{
+    struct wl_resource* resource;
+
+    resource = wl_resource_create(client, &wl_output_interface, version, id);
+    if (!resource)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, NULL, NULL, NULL);
+    wl_output_send_geometry(resource, 0, 0, 530, 300,
+                            WL_OUTPUT_SUBPIXEL_UNKNOWN, "mock", "headless",
+                            WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource,
+                        WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED,
+                        OUTPUT_WIDTH, OUTPUT_HEIGHT, compositor.refresh_mhz);
+    if (version >= WL_OUTPUT_SCALE_SINCE_VERSION)
+        wl_output_send_scale(resource, 1);
+    if (version >= WL_OUTPUT_DONE_SINCE_VERSION)
+        wl_output_send_done(resource);
+}
+
+/*
+ * One vblank: what was committed since the last one is on screen now.
+ * A refresh the loop was too late for is counted, not made up for.
+ */
+static int refresh(int fd, uint32_t mask, void* data)
+{
+    struct surface*     surface;
+    struct wl_resource *callback, *next;
+    uint64_t            expirations, now = clock_now_ns();
+    bool                shown = false;
+
+    if (read(fd, &expirations, sizeof expirations) != sizeof expirations)
+        return 0;
+    compositor.missed_refreshes += expirations - 1;
+
+    wl_list_for_each(surface, &compositor.surfaces, link)
+    {
+        shown |= surface->updated;
+        surface->updated = false;
+        if (!compositor.keep)
+            surface_release(surface);
+
+        wl_resource_for_each_safe(callback, next, &surface->callbacks)
+        {
+            wl_callback_send_done(callback, (uint32_t)(now / 1000000));
+            wl_resource_destroy(callback);
+            surface->done_ns = now;
+        }
+    }
+
+    if (shown)
+        compositor.frames++;
+
+    return 0;
+}
+
+static int deadline(void* data)
+{
+    if (!compositor.terminated)
+    {
+        compositor.end_ns     = clock_now_ns();
+        compositor.terminated = true;
+        kill(compositor.pid, SIGTERM);
+        wl_event_source_timer_update(compositor.deadline, KILL_TIMEOUT_MS);
+    }
+    else
+    {
+        fprintf(stderr, "client did not exit, killing it\n");
+        kill(compositor.pid, SIGKILL);
+    }
+
+    return 0;
+}
+
+static void client_destroyed(struct wl_listener* listener, void* data)
+{
+    if (!compositor.end_ns)
+        compositor.end_ns = clock_now_ns();
+    compositor.client = NULL;
+    wl_display_terminate(compositor.display);
+}
+
+/* Start the client with its end of a socket pair as WAYLAND_SOCKET. */
+static int spawn_client(char** argv)
+{
+    char fd_str[16];
+    int  sv[2];
+
+    if (os_socketpair_cloexec(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return -1;
+
+    compositor.pid = fork();
+    if (compositor.pid < 0)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (compositor.pid == 0)
+    {
+        /* the cloexec copy goes away with exec, this one stays */
+        snprintf(fd_str, sizeof fd_str, "%d", dup(sv[1]));
+        setenv("WAYLAND_SOCKET", fd_str, 1);
+        execvp(argv[0], argv);
+        fprintf(stderr, "cannot run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+
+    close(sv[1]);
+    compositor.client = wl_client_create(compositor.display, sv[0]);
+    if (!compositor.client)
+    {
+        close(sv[0]);
+        kill(compositor.pid, SIGKILL);
+        return -1;
+    }
+
+    compositor.client_destroy.notify = client_destroyed;
+    wl_client_add_destroy_listener(compositor.client,
+                                   &compositor.client_destroy);
+
+    return 0;
+}
+
+static void write_histogram(const char* name, const struct histogram* h)
+{
+    printf(",\n \"%s\": {\"count\": %" PRIu64 ", \"mean_ns\": %.0f, "
+           "\"p50_ns\": %" PRIu64 ", \"p90_ns\": %" PRIu64
+           ", \"p99_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 "}",
+           name, h->count, histogram_mean(h), histogram_percentile(h, 50),
+           histogram_percentile(h, 90), histogram_percentile(h, 99), h->max);
+}
+
+static void write_report(void)
+{
+    double seconds = 0.0;
+
+    if (compositor.start_ns && compositor.end_ns > compositor.start_ns)
+        seconds = (compositor.end_ns - compositor.start_ns) / 1e9;
+
+    printf("{\"refresh_hz\": %.3f, \"keep\": %s, \"seconds\": %.3f, "
+           "\"frames\": %" PRIu64 ", \"fps\": %.2f,\n"
+           " \"commits\": %" PRIu64 ", \"buffer_commits\": %" PRIu64
+           ", \"replaced\": %" PRIu64 ", \"repeated\": %" PRIu64
+           ", \"configure_acks\": %" PRIu64 ", \"missed_refreshes\": %" PRIu64,
+           compositor.refresh_mhz / 1000.0, compositor.keep ? "true" : "false",
+           seconds, compositor.frames,
+           seconds > 0.0 ? compositor.frames / seconds : 0.0,
+           compositor.commits, compositor.buffer_commits, compositor.replaced,
+           compositor.repeated, compositor.acks, compositor.missed_refreshes);
+    write_histogram("frame_to_commit", &compositor.frame_to_commit);
+    write_histogram("commit_to_release", &compositor.commit_to_release);
+
+    /* by now the client's surfaces are gone and recorded */
+    printf(",\n \"checksums\": [");
+    for (size_t i = 0; i < compositor.checksums.size(); i++)
+        printf("%s\"%016" PRIx64 "\"", i ? ", " : "",
+               compositor.checksums[i]);
+    printf("],\n \"exit_status\": %d}\n", compositor.status);
+}
+
+static void usage(int error_code)
+{
+    fprintf(stderr,
+            "Usage: mock-compositor [OPTIONS] -- CLIENT [ARGS...]\n\n"
+            "  -r, --refresh HZ      Synthetic refresh rate, default 60\n"
+            "  -d, --duration SECS   Run time before the client is "
+            "terminated, default 10\n"
+            "  -k, --keep            Hold buffers until replaced instead of "
+            "releasing them at the next refresh\n"
+            "  -h, --help            This help text\n\n");
+
+    exit(error_code);
+}
+
+int main(int argc, char** argv)
+{
+    struct wl_event_loop* loop;
+    struct itimerspec     period;
+    uint64_t              period_ns;
+    double                hz       = 60.0;
+    double                duration = 10.0;
+    int                   timer_fd, i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp("-r", argv[i]) == 0 ||
+             strcmp("--refresh", argv[i]) == 0) &&
+            i + 1 < argc)
+            hz = atof(argv[++i]);
+        else if ((strcmp("-d", argv[i]) == 0 ||
+                  strcmp("--duration", argv[i]) == 0) &&
+                 i + 1 < argc)
+            duration = atof(argv[++i]);
+        else if (strcmp("-k", argv[i]) == 0 ||
+                 strcmp("--keep", argv[i]) == 0)
+            compositor.keep = true;
+        else if (strcmp("--", argv[i]) == 0)
+            break;
+        else if (strcmp("-h", argv[i]) == 0 ||
+                 strcmp("--help", argv[i]) == 0)
+            usage(EXIT_SUCCESS);
+        else
+            usage(EXIT_FAILURE);
+    }
+    if (i + 1 >= argc || hz <= 0.0 || duration <= 0.0)
+        usage(EXIT_FAILURE);
+
+    compositor.refresh_mhz = (int)(hz * 1000.0 + 0.5);
+    histogram_init(&compositor.frame_to_commit);
+    histogram_init(&compositor.commit_to_release);
+    wl_list_init(&compositor.surfaces);
+
+    /* a client gone mid-write must not take us down */
+    signal(SIGPIPE, SIG_IGN);
+
+    compositor.display = wl_display_create();
+    loop               = wl_display_get_event_loop(compositor.display);
+    if (wl_display_init_shm(compositor.display) < 0 ||
+        !wl_global_create(compositor.display, &wl_compositor_interface, 4,
+                          NULL, bind_compositor) ||
+        !wl_global_create(compositor.display, &xdg_wm_base_interface, 1,
+                          NULL, bind_wm_base) ||
+        !wl_global_create(compositor.display, &wl_output_interface, 2, NULL,
+                          bind_output))
+    {
+        fprintf(stderr, "failed to create the globals\n");
+        return 1;
+    }
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    /* below 1 Hz the period takes whole seconds, and 0 would disarm */
+    period_ns = (uint64_t)(1e9 / hz);
+    if (!period_ns)
+        period_ns = 1;
+    period.it_interval.tv_sec  = period_ns / 1000000000ull;
+    period.it_interval.tv_nsec = period_ns % 1000000000ull;
+    period.it_value            = period.it_interval;
+    if (timer_fd < 0 || timerfd_settime(timer_fd, 0, &period, NULL) < 0)
+    {
+        fprintf(stderr, "failed to set up the refresh timer: %s\n",
+                strerror(errno));
+        return 1;
+    }
+    compositor.refresh = wl_event_loop_add_fd(loop, timer_fd,
+                                              WL_EVENT_READABLE, refresh,
+                                              NULL);
+    compositor.deadline = wl_event_loop_add_timer(loop, deadline, NULL);
+
+    if (spawn_client(argv + i + 1) < 0)
+    {
+        fprintf(stderr, "failed to start %s: %s\n", argv[i + 1],
+                strerror(errno));
+        return 1;
+    }
+    wl_event_source_timer_update(compositor.deadline,
+                                 (int)(duration * 1000.0));
+
+    wl_display_run(compositor.display);
+
+    waitpid(compositor.pid, &compositor.status, 0);
+    compositor.status = WIFEXITED(compositor.status) ?
+        WEXITSTATUS(compositor.status) :
+        128 + WTERMSIG(compositor.status);
+    write_report();
+
+    wl_event_source_remove(compositor.deadline);
+    wl_event_source_remove(compositor.refresh);
+    close(timer_fd);
+    wl_display_destroy(compositor.display);
+
+    return 0;
+}
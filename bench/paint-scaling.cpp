@@ -0,0 +1,167 @@
+/*
+ * Scaling benchmark for the banded painter: composite a surface with a
+ * handful of watermark-sized images using 1 to N threads and report the
+ * median frame time and the speedup over one thread.  Besides 4K it
+ * runs widths whose stride is not a multiple of a page: 1366x768, and
+ * 1707x960, a 2560x1440 output at 1.5 scale.
+ *
+ * Usage: paint-scaling [MAX_THREADS [ITERATIONS]]
+ */
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "asset.h"
+#include "clock.h"
+#include "paint.h"
+#include "thread-pool.h"
+
+struct size
+{
+    int width, height;
+};
+
+static const struct size sizes[] = {
+    {3840, 2160},
+    {1366, 768},
+    {1707, 960},
+};
+
+/* A premultiplied image with a soft alpha gradient, like text on a blur. */
+static void make_asset(struct asset* asset, int width, int height)
+{
+    memset(asset, 0, sizeof *asset);
+    asset->width  = width;
+    asset->height = height;
+    asset->stride = width * 4;
+    asset->pixels = (uint32_t*)malloc((size_t)width * height * 4);
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t a = (x * 255 / width + y * 255 / height) / 2;
+
+            asset->pixels[y * width + x] = a << 24 | (a / 2) << 16 | a / 3;
+        }
+    }
+}
+
+static double run(struct thread_pool*       pool,
+                  uint32_t*                 pixels,
+                  const struct size*        size,
+                  const struct paint_layer* layers,
+                  int                       n_layers,
+                  int                       iterations)
+{
+    std::vector<uint64_t> samples;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        uint64_t start = clock_now_ns();
+
+        paint_surface(pool, pixels, size->width, size->height, layers,
+                      n_layers, 200, NULL);
+        samples.push_back(clock_now_ns() - start);
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    return samples[samples.size() / 2] / 1e6;
+}
+
+/* Returns false when a thread count paints something else than one. */
+static bool bench_size(const struct size*        size,
+                       int                       max_threads,
+                       int                       iterations,
+                       const struct paint_layer* layers,
+                       int                       n_layers)
+{
+    size_t    bytes = (size_t)size->width * size->height * 4;
+    uint32_t *pixels, *reference;
+    double    base = 0.0, ms;
+
+    pixels = (uint32_t*)mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    reference = (uint32_t*)malloc(bytes);
+    if (pixels == MAP_FAILED || !reference)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    paint_surface(NULL, reference, size->width, size->height, layers,
+                  n_layers, 200, NULL);
+
+    printf("%dx%d, %d iterations\n", size->width, size->height,
+           iterations);
+    printf("threads  band rows  median ms  speedup\n");
+    for (int n = 1; n <= max_threads; n++)
+    {
+        struct thread_pool* pool = thread_pool_create(n);
+
+        ms = run(pool, pixels, size, layers, n_layers, iterations);
+        if (n == 1)
+            base = ms;
+
+        if (memcmp(pixels, reference, bytes) != 0)
+        {
+            fprintf(stderr, "%dx%d, %d threads: output differs\n",
+                    size->width, size->height, n);
+            return false;
+        }
+
+        printf("%7d  %9d  %9.3f  %6.2fx\n", thread_pool_size(pool),
+               paint_band_rows(size->width, size->height,
+                               thread_pool_size(pool)),
+               ms, base / ms);
+        thread_pool_destroy(pool);
+    }
+
+    munmap(pixels, bytes);
+    free(reference);
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int                max_threads = thread_pool_cpu_count();
+    int                iterations  = 50;
+    struct asset       big, small;
+    struct paint_layer layers[4];
+    bool               first = true;
+
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+
+    make_asset(&big, 1200, 400);
+    make_asset(&small, 300, 100);
+    layers[0] = {&big, 100, 100};
+    layers[1] = {&small, -50, 900};
+    layers[2] = {&big, 2800, 1900};
+    layers[3] = {&small, 3700, -20};
+
+    for (const struct size& size : sizes)
+    {
+        if (!first)
+            printf("\n");
+        first = false;
+        if (!bench_size(&size, max_threads, iterations, layers, 4))
+            return 1;
+    }
+
+    free(big.pixels);
+    free(small.pixels);
+
+    return 0;
+}
@@ -0,0 +1,457 @@
+#include "config.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+#include "event-loop.h"
+#include "os-compatibility.h"
+#include "zalloc.h"
+
+#define MAX_EVENTS 32
+
+enum event_source_type
+{
+    EVENT_SOURCE_FD,
+    EVENT_SOURCE_TIMER,
+    EVENT_SOURCE_SIGNAL,
+    EVENT_SOURCE_NOTIFY,
+};
+
+struct event_source
+{
+    struct event_loop*     loop;
+    struct wl_list         link;
+    enum event_source_type type;
+    int                    fd;
+    uint32_t               mask;
+    int                    signum;
+
+    event_loop_fd_func_t     fd_func;
+    event_loop_func_t        func;
+    event_loop_signal_func_t signal_func;
+    void*                    data;
+};
+
+struct event_loop
+{
+    int                  epoll_fd;
+    struct wl_list       source_list;
+    struct wl_list       destroy_list;
+    struct wl_display*     display;
+    struct wl_event_queue* queue;
+    struct event_source*   display_source;
+};
+
+static uint32_t epoll_mask(uint32_t mask)
+{
+    uint32_t events = 0;
+
+    if (mask & EVENT_LOOP_READABLE)
+        events |= EPOLLIN;
+    if (mask & EVENT_LOOP_WRITABLE)
+        events |= EPOLLOUT;
+
+    return events;
+}
+
+static uint32_t loop_mask(uint32_t events)
+{
+    uint32_t mask = 0;
+
+    if (events & EPOLLIN)
+        mask |= EVENT_LOOP_READABLE;
+    if (events & EPOLLOUT)
+        mask |= EVENT_LOOP_WRITABLE;
+    if (events & EPOLLHUP)
+        mask |= EVENT_LOOP_HANGUP;
+    if (events & EPOLLERR)
+        mask |= EVENT_LOOP_ERROR;
+
+    return mask;
+}
+
+static struct event_source* add_source(struct event_loop*     loop,
+                                       enum event_source_type type,
+                                       int                    fd,
+                                       uint32_t               mask,
+                                       void*                  data)
+{
+    struct event_source* source;
+    struct epoll_event   ep = {};
+
+    if (fd < 0)
+        return NULL;
+
+    source = (struct event_source*)zalloc(sizeof *source);
+    if (!source)
+        return NULL;
+
+    source->loop = loop;
+    source->type = type;
+    source->fd   = fd;
+    source->mask = mask;
+    source->data = data;
+
+    ep.events   = epoll_mask(mask);
+    ep.data.ptr = source;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ep) < 0)
+    {
+        free(source);
+        return NULL;
+    }
+
+    wl_list_insert(loop->source_list.prev, &source->link);
+
+    return source;
+}
+
+struct event_loop* event_loop_create(void)
+{
+    struct event_loop* loop;
+
+    loop = (struct event_loop*)zalloc(sizeof *loop);
+    if (!loop)
+        return NULL;
+
+    loop->epoll_fd = os_epoll_create_cloexec();
+    if (loop->epoll_fd < 0)
+    {
+        free(loop);
+        return NULL;
+    }
+
+    wl_list_init(&loop->source_list);
+    wl_list_init(&loop->destroy_list);
+
+    return loop;
+}
+
+static void free_removed_sources(struct event_loop* loop)
+{
+    struct event_source *source, *tmp;
+
+    wl_list_for_each_safe(source, tmp, &loop->destroy_list, link)
+    {
+        wl_list_remove(&source->link);
+        free(source);
+    }
+}
+
+void event_loop_destroy(struct event_loop* loop)
+{
+    struct event_source *source, *tmp;
+
+    wl_list_for_each_safe(source, tmp, &loop->source_list, link)
+        event_source_remove(source);
+    free_removed_sources(loop);
+
+    close(loop->epoll_fd);
+    free(loop);
+}
+
+int event_loop_add_display(struct event_loop*     loop,
+                           struct wl_display*     display,
+                           struct wl_event_queue* queue)
+{
+    loop->display_source =
+        add_source(loop, EVENT_SOURCE_FD, wl_display_get_fd(display),
+                   EVENT_LOOP_READABLE, NULL);
+    if (!loop->display_source)
+        return -1;
+
+    loop->display = display;
+    loop->queue   = queue;
+
+    return 0;
+}
+
+struct event_source* event_loop_add_fd(struct event_loop*   loop,
+                                       int                  fd,
+                                       uint32_t             mask,
+                                       event_loop_fd_func_t func,
+                                       void*                data)
+{
+    struct event_source* source;
+
+    source = add_source(loop, EVENT_SOURCE_FD, fd, mask, data);
+    if (source)
+        source->fd_func = func;
+
+    return source;
+}
+
+int event_source_fd_update(struct event_source* source, uint32_t mask)
+{
+    struct epoll_event ep = {};
+
+    ep.events   = epoll_mask(mask);
+    ep.data.ptr = source;
+    if (epoll_ctl(source->loop->epoll_fd, EPOLL_CTL_MOD, source->fd, &ep) < 0)
+        return -1;
+
+    source->mask = mask;
+
+    return 0;
+}
+
+struct event_source* event_loop_add_timer(struct event_loop* loop,
+                                          event_loop_func_t  func,
+                                          void*              data)
+{
+    struct event_source* source;
+    int                  fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    source =
+        add_source(loop, EVENT_SOURCE_TIMER, fd, EVENT_LOOP_READABLE, data);
+    if (!source)
+    {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    source->func = func;
+
+    return source;
+}
+
+int event_source_timer_update(struct event_source* source,
+                              uint64_t             deadline_ns)
+{
+    struct itimerspec its = {};
+
+    its.it_value.tv_sec  = deadline_ns / 1000000000ull;
+    its.it_value.tv_nsec = deadline_ns % 1000000000ull;
+
+    return timerfd_settime(source->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*
+ * The signal is blocked for the whole process so it is only ever seen
+ * through the signalfd.  Call this before starting any thread, so the
+ * threads inherit the mask.
+ */
+struct event_source* event_loop_add_signal(struct event_loop*       loop,
+                                           int                      signum,
+                                           event_loop_signal_func_t func,
+                                           void*                    data)
+{
+    struct event_source* source;
+    sigset_t             mask, saved;
+    int                  fd;
+
+    /* blocked first, or a signal in between takes its default action */
+    sigemptyset(&mask);
+    sigaddset(&mask, signum);
+    sigprocmask(SIG_BLOCK, &mask, &saved);
+    fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    source =
+        add_source(loop, EVENT_SOURCE_SIGNAL, fd, EVENT_LOOP_READABLE, data);
+    if (!source)
+    {
+        if (fd >= 0)
+            close(fd);
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+        return NULL;
+    }
+
+    source->signum      = signum;
+    source->signal_func = func;
+
+    return source;
+}
+
+struct event_source* event_loop_add_notify(struct event_loop* loop,
+                                           event_loop_func_t  func,
+                                           void*              data)
+{
+    struct event_source* source;
+    int                  fd;
+
+    fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    source =
+        add_source(loop, EVENT_SOURCE_NOTIFY, fd, EVENT_LOOP_READABLE, data);
+    if (!source)
+    {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    source->func = func;
+
+    return source;
+}
+
+void event_source_notify(struct event_source* source)
+{
+    uint64_t one = 1;
+
+    /* a full counter still wakes the loop, so EAGAIN is harmless */
+    if (write(source->fd, &one, sizeof one) < 0 && errno != EAGAIN)
+        return;
+}
+
+void event_source_remove(struct event_source* source)
+{
+    struct event_loop* loop = source->loop;
+
+    if (source->fd < 0)
+        return;
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+    if (source->type != EVENT_SOURCE_FD)
+        close(source->fd);
+    source->fd = -1;
+
+    if (source == loop->display_source)
+    {
+        loop->display_source = NULL;
+        loop->display        = NULL;
+    }
+
+    wl_list_remove(&source->link);
+    wl_list_insert(&loop->destroy_list, &source->link);
+}
+
+static int prepare_read(struct event_loop* loop)
+{
+    if (loop->queue)
+        return wl_display_prepare_read_queue(loop->display, loop->queue);
+
+    return wl_display_prepare_read(loop->display);
+}
+
+static int dispatch_pending(struct event_loop* loop)
+{
+    if (loop->queue)
+        return wl_display_dispatch_queue_pending(loop->display, loop->queue);
+
+    return wl_display_dispatch_pending(loop->display);
+}
+
+static void dispatch_source(struct event_source* source, uint32_t events)
+{
+    struct signalfd_siginfo info;
+    uint64_t                count;
+
+    switch (source->type)
+    {
+    case EVENT_SOURCE_FD:
+        source->fd_func(source->fd, loop_mask(events), source->data);
+        break;
+    case EVENT_SOURCE_TIMER:
+    case EVENT_SOURCE_NOTIFY:
+        if (read(source->fd, &count, sizeof count) != sizeof count)
+            break;
+        source->func(source->data);
+        break;
+    case EVENT_SOURCE_SIGNAL:
+        if (read(source->fd, &info, sizeof info) != sizeof info)
+            break;
+        source->signal_func(info.ssi_signo, source->data);
+        break;
+    }
+}
+
+/*
+ * Flush once.  If the socket buffer is full the remaining requests stay
+ * queued in libwayland; watch the fd for writability until the
+ * compositor has drained it, and flush again on the next iteration.
+ */
+static int flush_display(struct event_loop* loop)
+{
+    uint32_t mask = EVENT_LOOP_READABLE;
+
+    if (wl_display_flush(loop->display) < 0)
+    {
+        if (errno != EAGAIN)
+            return -1;
+        mask |= EVENT_LOOP_WRITABLE;
+    }
+
+    if (mask != loop->display_source->mask &&
+        event_source_fd_update(loop->display_source, mask) < 0)
+        return -1;
+
+    return 0;
+}
+
+int event_loop_dispatch(struct event_loop* loop, int timeout)
+{
+    struct epoll_event   ep[MAX_EVENTS];
+    struct event_source* source;
+    struct wl_display*   display = loop->display;
+    uint32_t             display_events = 0;
+    int                  count, i;
+
+    if (display)
+    {
+        while (prepare_read(loop) != 0)
+        {
+            if (dispatch_pending(loop) < 0)
+                return -1;
+        }
+
+        if (flush_display(loop) < 0)
+        {
+            wl_display_cancel_read(display);
+            return -1;
+        }
+    }
+
+    count = epoll_wait(loop->epoll_fd, ep, MAX_EVENTS, timeout);
+    if (count < 0)
+    {
+        if (display)
+            wl_display_cancel_read(display);
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (i = 0; display && i < count; i++)
+    {
+        if (ep[i].data.ptr == loop->display_source)
+            display_events = ep[i].events;
+    }
+
+    if (display)
+    {
+        if (display_events & EPOLLIN)
+        {
+            if (wl_display_read_events(display) < 0)
+                return -1;
+        }
+        else
+        {
+            wl_display_cancel_read(display);
+            if (display_events & (EPOLLHUP | EPOLLERR))
+                return -1;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        source = (struct event_source*)ep[i].data.ptr;
+        if (source->fd < 0 || source == loop->display_source)
+            continue;
+        dispatch_source(source, ep[i].events);
+    }
+
+    free_removed_sources(loop);
+
+    if (loop->display && dispatch_pending(loop) < 0)
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+
+struct wl_display;
+struct wl_event_queue;
+struct event_loop;
+struct event_source;
+
+#define EVENT_LOOP_READABLE 0x01
+#define EVENT_LOOP_WRITABLE 0x02
+#define EVENT_LOOP_HANGUP 0x04
+#define EVENT_LOOP_ERROR 0x08
+
+typedef void (*event_loop_fd_func_t)(int fd, uint32_t mask, void* data);
+typedef void (*event_loop_func_t)(void* data);
+typedef void (*event_loop_signal_func_t)(int signum, void* data);
+
+/*
+ * A single-threaded epoll loop, modelled on wl_event_loop.
+ *
+ * Besides plain fds it can wait on timers (timerfd), signals (signalfd)
+ * and notifications (eventfd).  A notification is the one thing that may
+ * be triggered from another thread, to hand work back to the loop.
+ *
+ * With a wl_display attached, every iteration follows the
+ * prepare_read/read_events protocol: pending events are dispatched, the
+ * request queue is flushed once, and the display fd is read only if epoll
+ * reported it readable.  A flush that fails with EAGAIN leaves the rest
+ * of the queue in libwayland and waits for the socket to become writable
+ * again instead of spinning.
+ *
+ * Each thread that dispatches Wayland events runs a loop of its own,
+ * attached to the display with the wl_event_queue it owns (NULL for the
+ * default queue).  libwayland arbitrates which thread reads the socket.
+ *
+ * Callbacks may remove any source, including their own; the memory is
+ * released at the end of the iteration.
+ */
+struct event_loop* event_loop_create(void);
+
+void event_loop_destroy(struct event_loop* loop);
+
+int event_loop_add_display(struct event_loop*     loop,
+                           struct wl_display*     display,
+                           struct wl_event_queue* queue);
+
+struct event_source* event_loop_add_fd(struct event_loop*   loop,
+                                       int                  fd,
+                                       uint32_t             mask,
+                                       event_loop_fd_func_t func,
+                                       void*                data);
+
+int event_source_fd_update(struct event_source* source, uint32_t mask);
+
+struct event_source* event_loop_add_timer(struct event_loop* loop,
+                                          event_loop_func_t  func,
+                                          void*              data);
+
+/* Arm at an absolute CLOCK_MONOTONIC time in ns, 0 disarms. */
+int event_source_timer_update(struct event_source* source,
+                              uint64_t             deadline_ns);
+
+struct event_source* event_loop_add_signal(struct event_loop*       loop,
+                                           int                      signum,
+                                           event_loop_signal_func_t func,
+                                           void*                    data);
+
+struct event_source* event_loop_add_notify(struct event_loop* loop,
+                                           event_loop_func_t  func,
+                                           void*              data);
+
+/* Safe to call from any thread. */
+void event_source_notify(struct event_source* source);
+
+void event_source_remove(struct event_source* source);
+
+/*
+ * Run one iteration, waiting at most timeout ms (-1 for ever).  Returns
+ * -1 when the display connection is lost or epoll fails, 0 otherwise.
+ */
+int event_loop_dispatch(struct event_loop* loop, int timeout);
+
+#endif /* EVENT_LOOP_H */
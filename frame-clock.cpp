@@ -0,0 +1,210 @@
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "clock.h"
+#include "frame-clock.h"
+
+static uint64_t clock_now(clockid_t clk_id)
+{
+    struct timespec ts;
+
+    clock_gettime(clk_id, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint64_t frame_clock_now(void)
+{
+    return clock_now_ns();
+}
+
+void frame_clock_init(struct frame_clock* clock)
+{
+    memset(clock, 0, sizeof *clock);
+    histogram_init(&clock->present_latency);
+    histogram_init(&clock->refresh);
+    clock->margin_ns = FRAME_CLOCK_DEFAULT_MARGIN_NS;
+}
+
+/*
+ * Translate a timestamp taken on clk_id (the compositor's presentation
+ * clock) to CLOCK_MONOTONIC by sampling both clocks now.  The offset is
+ * only as good as the two clock_gettime() calls are close, which is
+ * plenty for latencies in the millisecond range.
+ */
+uint64_t frame_clock_to_monotonic(clockid_t clk_id, uint64_t ts)
+{
+    uint64_t other, mono;
+
+    if (clk_id == CLOCK_MONOTONIC)
+        return ts;
+
+    other = clock_now(clk_id);
+    mono  = frame_clock_now();
+
+    return mono - (int64_t)(other - ts);
+}
+
+void frame_clock_frame_done(struct frame_clock* clock, uint64_t now)
+{
+    clock->callbacks++;
+    clock->done_ns = now;
+}
+
+/*
+ * A commit that was not triggered by a frame callback (the first frame,
+ * or an update while the loop was idle) has no latency to account.
+ */
+void frame_clock_committed(struct frame_clock* clock, uint64_t now)
+{
+    uint64_t latency;
+
+    clock->frames++;
+    if (!clock->done_ns)
+        return;
+
+    latency = now - clock->done_ns;
+    clock->latency_count++;
+    clock->latency_sum_ns += latency;
+    if (latency > clock->latency_max_ns)
+        clock->latency_max_ns = latency;
+
+    clock->done_ns = 0;
+}
+
+/*
+ * A presented event for the commit made at commit_ns, which was painted
+ * for the vblank at target_ns (0 when it was not scheduled).  A
+ * present_ns before the commit means the clocks could not be correlated,
+ * the sample is dropped rather than recorded as a bogus latency.
+ *
+ * waited says whether the frame had been wanted since the previous one
+ * (it was drawn off a frame callback).  Otherwise the window was idle
+ * and the cycles since the last presentation were not skipped.
+ */
+void frame_clock_presented(struct frame_clock* clock,
+                           uint64_t            commit_ns,
+                           uint64_t            target_ns,
+                           uint64_t            present_ns,
+                           uint32_t            refresh_ns,
+                           uint64_t            seq,
+                           bool                waited)
+{
+    clock->presented++;
+
+    if (target_ns && present_ns > target_ns + refresh_ns / 2)
+        clock->missed++;
+
+    if (present_ns >= commit_ns)
+        histogram_record(&clock->present_latency, present_ns - commit_ns);
+
+    if (refresh_ns)
+    {
+        histogram_record(&clock->refresh, refresh_ns);
+        clock->refresh_ns = refresh_ns;
+    }
+
+    if (waited && seq && clock->last_seq && seq > clock->last_seq + 1)
+        clock->skipped += seq - clock->last_seq - 1;
+
+    clock->last_seq        = seq;
+    clock->last_present_ns = present_ns;
+}
+
+void frame_clock_discarded(struct frame_clock* clock)
+{
+    clock->discarded++;
+}
+
+/*
+ * Exponentially weighted average of the paint time.  It follows an
+ * increase quickly and decays slowly, so one cheap frame after an
+ * expensive one does not make the next deadline too tight.
+ */
+void frame_clock_paint_time(struct frame_clock* clock, uint64_t ns)
+{
+    if (ns > clock->paint_ewma_ns)
+        clock->paint_ewma_ns += (ns - clock->paint_ewma_ns) / 2;
+    else
+        clock->paint_ewma_ns -= (clock->paint_ewma_ns - ns) / 16;
+}
+
+/*
+ * First vblank at or after t, extrapolated from the last presentation
+ * and the refresh interval.  0 when there is nothing to predict from.
+ */
+uint64_t frame_clock_next_vblank(const struct frame_clock* clock, uint64_t t)
+{
+    uint64_t cycles;
+
+    if (!clock->refresh_ns || !clock->last_present_ns)
+        return 0;
+
+    if (t <= clock->last_present_ns)
+        return clock->last_present_ns;
+
+    cycles = (t - clock->last_present_ns + clock->refresh_ns - 1) /
+        clock->refresh_ns;
+
+    return clock->last_present_ns + cycles * clock->refresh_ns;
+}
+
+/*
+ * When to start painting so that the frame is done just in time for
+ * the earliest vblank it can still make.  Returns now, and a zero
+ * target, when no vblank can be predicted.
+ */
+uint64_t frame_clock_paint_deadline(const struct frame_clock* clock,
+                                   uint64_t                  now,
+                                   uint64_t*                 target_ns)
+{
+    uint64_t lead = clock->paint_ewma_ns + clock->margin_ns;
+
+    *target_ns = frame_clock_next_vblank(clock, now + lead);
+    if (!*target_ns)
+        return now;
+
+    return *target_ns - lead;
+}
+
+void frame_clock_report(const struct frame_clock* clock, FILE* fp)
+{
+    fprintf(fp, "%" PRIu64 " frames, %" PRIu64 " frame callbacks\n",
+            clock->frames, clock->callbacks);
+
+    if (clock->latency_count)
+        fprintf(fp, "callback to commit: avg %.1f us, max %.1f us\n",
+                clock->latency_sum_ns / 1000.0 / clock->latency_count,
+                clock->latency_max_ns / 1000.0);
+
+    if (!clock->presented && !clock->discarded)
+        return;
+
+    fprintf(fp,
+            "%" PRIu64 " presented, %" PRIu64 " discarded, %" PRIu64
+            " refresh cycles skipped, %" PRIu64 " deadlines missed\n",
+            clock->presented, clock->discarded, clock->skipped,
+            clock->missed);
+
+    if (clock->present_latency.count)
+        fprintf(fp,
+                "commit to present: p50 %.2f ms, p90 %.2f ms, "
+                "p99 %.2f ms, max %.2f ms\n",
+                histogram_percentile(&clock->present_latency, 50) / 1e6,
+                histogram_percentile(&clock->present_latency, 90) / 1e6,
+                histogram_percentile(&clock->present_latency, 99) / 1e6,
+                clock->present_latency.max / 1e6);
+
+    if (clock->refresh.count)
+        fprintf(fp, "refresh interval: p50 %.3f ms (%.2f Hz)\n",
+                histogram_percentile(&clock->refresh, 50) / 1e6,
+                1e9 / histogram_percentile(&clock->refresh, 50));
+
+    fprintf(fp, "paint time estimate: %.1f us\n",
+            clock->paint_ewma_ns / 1000.0);
+}
@@ -0,0 +1,89 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "histogram.h"
+
+/* Default slack between the end of painting and the predicted vblank. */
+#define FRAME_CLOCK_DEFAULT_MARGIN_NS 2000000ull
+
+/*
+ * Timing bookkeeping for the frame callback loop.
+ *
+ * All timestamps are CLOCK_MONOTONIC nanoseconds.  The clock only
+ * records what happened; requesting and servicing wl_surface.frame
+ * callbacks and wp_presentation feedback is left to the window.
+ */
+struct frame_clock
+{
+    uint64_t frames;
+    uint64_t callbacks;
+
+    /* When the last frame callback fired, 0 once it has been used. */
+    uint64_t done_ns;
+
+    /* Frame callback to wl_surface.commit latency. */
+    uint64_t latency_count;
+    uint64_t latency_sum_ns;
+    uint64_t latency_max_ns;
+
+    /*
+     * wp_presentation feedback: commit to first light on the output,
+     * the output refresh interval, and how many commits never made it
+     * to the screen.  skipped counts refresh cycles between consecutive
+     * presented frames that did not show a new frame of ours although
+     * one was waiting to be drawn; idle cycles are not skips.
+     */
+    struct histogram present_latency;
+    struct histogram refresh;
+    uint64_t         presented;
+    uint64_t         discarded;
+    uint64_t         skipped;
+    uint64_t         last_present_ns;
+    uint64_t         last_seq;
+    uint64_t         refresh_ns;
+
+    /*
+     * Deadline scheduling: painting starts paint_ewma_ns + margin_ns
+     * before the predicted vblank.  missed counts frames that were
+     * presented later than the vblank they were painted for.
+     */
+    uint64_t paint_ewma_ns;
+    uint64_t margin_ns;
+    uint64_t missed;
+};
+
+void frame_clock_init(struct frame_clock* clock);
+
+uint64_t frame_clock_now(void);
+
+void frame_clock_frame_done(struct frame_clock* clock, uint64_t now);
+
+void frame_clock_committed(struct frame_clock* clock, uint64_t now);
+
+uint64_t frame_clock_to_monotonic(clockid_t clk_id, uint64_t ts);
+
+void frame_clock_presented(struct frame_clock* clock,
+                           uint64_t            commit_ns,
+                           uint64_t            target_ns,
+                           uint64_t            present_ns,
+                           uint32_t            refresh_ns,
+                           uint64_t            seq,
+                           bool                waited);
+
+void frame_clock_discarded(struct frame_clock* clock);
+
+void frame_clock_paint_time(struct frame_clock* clock, uint64_t ns);
+
+uint64_t frame_clock_next_vblank(const struct frame_clock* clock, uint64_t t);
+
+uint64_t frame_clock_paint_deadline(const struct frame_clock* clock,
+                                   uint64_t                  now,
+                                   uint64_t*                 target_ns);
+
+void frame_clock_report(const struct frame_clock* clock, FILE* fp);
+
+#endif /* FRAME_CLOCK_H */
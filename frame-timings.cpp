@@ -0,0 +1,98 @@
+#include "config.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame-timings.h"
+
+static const char* const phase_names[FRAME_PHASE_COUNT] = {
+    "acquire", "decode", "clear", "convert", "submit", "release"};
+
+const char* frame_phase_name(enum frame_phase phase)
+{
+    return phase_names[phase];
+}
+
+void frame_timings_init(struct frame_timings* timings)
+{
+    pthread_mutex_init(&timings->mutex, NULL);
+    for (int i = 0; i < FRAME_PHASE_COUNT; i++)
+        histogram_init(&timings->phases[i]);
+}
+
+void frame_timings_release(struct frame_timings* timings)
+{
+    pthread_mutex_destroy(&timings->mutex);
+}
+
+void frame_timings_record(struct frame_timings* timings,
+                          struct frame_sample*  sample)
+{
+    if (!sample->phases)
+        return;
+
+    pthread_mutex_lock(&timings->mutex);
+    for (int i = 0; i < FRAME_PHASE_COUNT; i++)
+    {
+        if (sample->phases & 1u << i)
+            histogram_record(&timings->phases[i], sample->ns[i]);
+    }
+    pthread_mutex_unlock(&timings->mutex);
+
+    memset(sample, 0, sizeof *sample);
+}
+
+void frame_timings_record_phase(struct frame_timings* timings,
+                                enum frame_phase      phase,
+                                uint64_t              ns)
+{
+    pthread_mutex_lock(&timings->mutex);
+    histogram_record(&timings->phases[phase], ns);
+    pthread_mutex_unlock(&timings->mutex);
+}
+
+static void write_histogram(const struct histogram* h, FILE* fp)
+{
+    bool first = true;
+
+    fprintf(fp,
+            "{\"count\": %" PRIu64 ", \"mean_ns\": %.1f, "
+            "\"min_ns\": %" PRIu64 ", \"p50_ns\": %" PRIu64
+            ", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+            ", \"p999_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64
+            ", \"buckets\": [",
+            h->count, histogram_mean(h), h->count ? h->min : 0,
+            histogram_percentile(h, 50), histogram_percentile(h, 90),
+            histogram_percentile(h, 99), histogram_percentile(h, 99.9),
+            h->max);
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        if (!h->buckets[i])
+            continue;
+
+        fprintf(fp, "%s[%" PRIu64 ", %" PRIu32 "]", first ? "" : ", ",
+                histogram_bucket_value(i), h->buckets[i]);
+        first = false;
+    }
+
+    fprintf(fp, "]}");
+}
+
+void frame_timings_write_json(struct frame_timings* timings, FILE* fp)
+{
+    pthread_mutex_lock(&timings->mutex);
+
+    fprintf(fp, "{");
+    for (int i = 0; i < FRAME_PHASE_COUNT; i++)
+    {
+        fprintf(fp, "%s\"%s\": ", i ? ", " : "", phase_names[i]);
+        write_histogram(&timings->phases[i], fp);
+    }
+    fprintf(fp, "}");
+
+    pthread_mutex_unlock(&timings->mutex);
+}
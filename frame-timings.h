@@ -0,0 +1,69 @@
+#ifndef FRAME_TIMINGS_H
+#define FRAME_TIMINGS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "histogram.h"
+
+/*
+ * Where the time of a frame goes, one histogram per phase.
+ *
+ * The render thread gathers a frame's phases in a frame_sample and
+ * records them in one go, so the mutex is taken once per frame and a
+ * dump from another thread always sees whole frames.  Clear and convert
+ * are CPU time summed over the paint bands, not wall time.
+ */
+enum frame_phase
+{
+    FRAME_PHASE_ACQUIRE, /* picking and (re)creating the next buffer */
+    FRAME_PHASE_DECODE,  /* resolving, decoding and scaling the images */
+    FRAME_PHASE_CLEAR,   /* clearing the buffer to transparent */
+    FRAME_PHASE_CONVERT, /* copying the images in with their alpha */
+    FRAME_PHASE_SUBMIT,  /* attach, damage, surface state and commit */
+    FRAME_PHASE_RELEASE, /* commit until the buffer is released */
+    FRAME_PHASE_COUNT
+};
+
+struct frame_sample
+{
+    uint64_t ns[FRAME_PHASE_COUNT];
+    uint32_t phases;
+};
+
+struct frame_timings
+{
+    pthread_mutex_t  mutex;
+    struct histogram phases[FRAME_PHASE_COUNT];
+};
+
+static inline void frame_sample_add(struct frame_sample* sample,
+                                    enum frame_phase     phase,
+                                    uint64_t             ns)
+{
+    sample->ns[phase] += ns;
+    sample->phases |= 1u << phase;
+}
+
+const char* frame_phase_name(enum frame_phase phase);
+
+void frame_timings_init(struct frame_timings* timings);
+
+void frame_timings_release(struct frame_timings* timings);
+
+/* Record the phases measured in sample, and clear it for the next frame. */
+void frame_timings_record(struct frame_timings* timings,
+                          struct frame_sample*  sample);
+
+void frame_timings_record_phase(struct frame_timings* timings,
+                                enum frame_phase      phase,
+                                uint64_t              ns);
+
+/*
+ * Write the histograms as a JSON object keyed by phase name: summary
+ * percentiles plus the non-empty buckets as [value, count] pairs.
+ */
+void frame_timings_write_json(struct frame_timings* timings, FILE* fp);
+
+#endif /* FRAME_TIMINGS_H */
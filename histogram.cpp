@@ -0,0 +1,93 @@
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define HALF_BUCKETS (HISTOGRAM_SUB_BUCKETS / 2)
+
+/*
+ * Values below HISTOGRAM_SUB_BUCKETS map to themselves.  A larger value
+ * is shifted right until it fits in [HALF_BUCKETS, HISTOGRAM_SUB_BUCKETS),
+ * and the shift picks the group of HALF_BUCKETS buckets it lands in.
+ */
+static int bucket_index(uint64_t value)
+{
+    int shift;
+
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return value;
+
+    shift = 63 - __builtin_clzll(value) - (HISTOGRAM_SUB_BITS - 1);
+
+    return (shift + 1) * HALF_BUCKETS + (value >> shift) - HALF_BUCKETS;
+}
+
+uint64_t histogram_bucket_value(int i)
+{
+    int      shift;
+    uint64_t sub;
+
+    if (i < HISTOGRAM_SUB_BUCKETS)
+        return i;
+
+    shift = i / HALF_BUCKETS - 1;
+    sub   = i % HALF_BUCKETS + HALF_BUCKETS;
+
+    return (sub << shift) + ((1ull << shift) >> 1);
+}
+
+void histogram_init(struct histogram* h)
+{
+    memset(h, 0, sizeof *h);
+    h->min = UINT64_MAX;
+}
+
+void histogram_record(struct histogram* h, uint64_t value)
+{
+    h->buckets[bucket_index(value)]++;
+    h->count++;
+    h->sum += value;
+    if (value < h->min)
+        h->min = value;
+    if (value > h->max)
+        h->max = value;
+}
+
+uint64_t histogram_percentile(const struct histogram* h, double p)
+{
+    uint64_t rank, seen = 0;
+    uint64_t value;
+
+    if (!h->count)
+        return 0;
+
+    rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > h->count)
+        rank = h->count;
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += h->buckets[i];
+        if (seen < rank)
+            continue;
+
+        /* the extremes are known exactly, don't round them */
+        value = histogram_bucket_value(i);
+        if (value < h->min)
+            value = h->min;
+        if (value > h->max)
+            value = h->max;
+        return value;
+    }
+
+    return h->max;
+}
+
+double histogram_mean(const struct histogram* h)
+{
+    return h->count ? (double)h->sum / h->count : 0.0;
+}
@@ -0,0 +1,40 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Log-linear histogram of unsigned samples, in the spirit of HdrHistogram.
+ *
+ * Values below HISTOGRAM_SUB_BUCKETS are counted exactly.  Above that every
+ * power of two is split into HISTOGRAM_SUB_BUCKETS / 2 linear sub-buckets,
+ * so any value read back is within 1 / HISTOGRAM_SUB_BUCKETS of a recorded
+ * one.  Recording is a couple of shifts and an increment, no allocation.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS                                                     \
+    ((64 - HISTOGRAM_SUB_BITS + 1) * (HISTOGRAM_SUB_BUCKETS / 2) +            \
+     HISTOGRAM_SUB_BUCKETS / 2)
+
+struct histogram
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min, max;
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_init(struct histogram* h);
+
+void histogram_record(struct histogram* h, uint64_t value);
+
+/* Value at percentile p (0..100), 0 for an empty histogram. */
+uint64_t histogram_percentile(const struct histogram* h, double p);
+
+double histogram_mean(const struct histogram* h);
+
+/* Midpoint of the range of values counted in bucket i. */
+uint64_t histogram_bucket_value(int i);
+
+#endif /* HISTOGRAM_H */
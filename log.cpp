@@ -0,0 +1,232 @@
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "clock.h"
+#include "log.h"
+
+#define LOG_SLOTS 256
+#define LOG_MESSAGE_SIZE 256
+
+/*
+ * A bounded queue in the manner of Vyukov's: a slot whose sequence
+ * equals the producer position is free, one past it is full, and the
+ * consumer hands it back a lap ahead.
+ */
+struct log_slot
+{
+    std::atomic<uint64_t> seq;
+    enum log_level        level;
+    char                  text[LOG_MESSAGE_SIZE];
+};
+
+static struct log_slot       slots[LOG_SLOTS];
+static std::atomic<uint64_t> tail;
+static uint64_t              head;
+static std::atomic<uint64_t> dropped;
+static uint64_t              reported;
+
+/*
+ * producers counts the log_message() calls that found the ring running
+ * and may still touch it or the semaphore; log_stop() waits them out.
+ */
+static std::atomic<bool> running;
+static std::atomic<int>  producers;
+static std::atomic<bool> quit;
+static sem_t             wakeup;
+static pthread_t         drainer;
+
+static const char* const level_names[] = {"info", "warning", "error"};
+
+static void write_line(enum log_level level, const char* text)
+{
+    fprintf(stderr, "%s: %s\n", level_names[level], text);
+}
+
+/* Only the drainer, or log_stop() once it is gone, consumes. */
+static void drain(void)
+{
+    struct log_slot* slot;
+    uint64_t         lost;
+
+    for (;;)
+    {
+        slot = &slots[head % LOG_SLOTS];
+        if (slot->seq.load(std::memory_order_acquire) != head + 1)
+            break;
+
+        write_line(slot->level, slot->text);
+        slot->seq.store(head + LOG_SLOTS, std::memory_order_release);
+        head++;
+    }
+
+    lost = dropped.load(std::memory_order_relaxed);
+    if (lost != reported)
+    {
+        fprintf(stderr, "warning: %llu log messages dropped\n",
+                (unsigned long long)(lost - reported));
+        reported = lost;
+    }
+}
+
+static void* drainer_main(void*)
+{
+    for (;;)
+    {
+        while (sem_wait(&wakeup) < 0)
+            ;
+        drain();
+        if (quit)
+            break;
+    }
+
+    return NULL;
+}
+
+int log_start(void)
+{
+    sigset_t all, saved;
+    int      ret;
+
+    for (uint64_t i = 0; i < LOG_SLOTS; i++)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    head = 0;
+    tail = 0;
+    quit = false;
+    if (sem_init(&wakeup, 0, 0) < 0)
+        return -1;
+
+    /* like the pool workers, the drainer takes no signals */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    ret = pthread_create(&drainer, NULL, drainer_main, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (ret != 0)
+    {
+        sem_destroy(&wakeup);
+        return -1;
+    }
+
+    running = true;
+
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!running)
+        return;
+
+    running = false;
+    while (producers.load() != 0)
+        sched_yield();
+
+    quit = true;
+    sem_post(&wakeup);
+    pthread_join(drainer, NULL);
+    sem_destroy(&wakeup);
+
+    /* whatever was queued while running was being cleared */
+    drain();
+}
+
+/* Whether the call site is still within its burst, see log.h. */
+static bool log_allowed(struct log_limit* limit, uint32_t* suppressed)
+{
+    uint64_t now   = clock_now_ns();
+    uint64_t start = limit->start_ns.load(std::memory_order_relaxed);
+
+    *suppressed = 0;
+    if (now - start >= LOG_INTERVAL_NS &&
+        limit->start_ns.compare_exchange_strong(start, now))
+    {
+        *suppressed = limit->suppressed.exchange(0);
+        limit->count.store(0);
+    }
+
+    if (limit->count.fetch_add(1) < LOG_BURST)
+        return true;
+
+    limit->suppressed++;
+
+    return false;
+}
+
+static void format_message(char*       text,
+                           uint32_t    suppressed,
+                           const char* fmt,
+                           va_list     args)
+{
+    int n = vsnprintf(text, LOG_MESSAGE_SIZE, fmt, args);
+
+    if (suppressed && n >= 0 && n < LOG_MESSAGE_SIZE)
+        snprintf(text + n, LOG_MESSAGE_SIZE - n,
+                 " (%u similar messages suppressed)", suppressed);
+}
+
+void log_message(struct log_limit* limit,
+                 enum log_level    level,
+                 const char*       fmt,
+                 ...)
+{
+    struct log_slot* slot;
+    char             text[LOG_MESSAGE_SIZE];
+    uint32_t         suppressed;
+    uint64_t         pos, seq;
+    va_list          args;
+
+    if (!log_allowed(limit, &suppressed))
+        return;
+
+    va_start(args, fmt);
+
+    /* announced before looking, so log_stop() cannot miss us */
+    producers++;
+    if (!running.load())
+    {
+        producers--;
+        format_message(text, suppressed, fmt, args);
+        write_line(level, text);
+        va_end(args);
+        return;
+    }
+
+    pos = tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        slot = &slots[pos % LOG_SLOTS];
+        seq  = slot->seq.load(std::memory_order_acquire);
+        if (seq == pos)
+        {
+            if (tail.compare_exchange_weak(pos, pos + 1,
+                                           std::memory_order_relaxed))
+                break;
+        }
+        else if (seq < pos)
+        {
+            dropped++;
+            producers--;
+            va_end(args);
+            return;
+        }
+        else
+        {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    format_message(slot->text, suppressed, fmt, args);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    va_end(args);
+
+    sem_post(&wakeup);
+    producers--;
+}
@@ -0,0 +1,60 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * Asynchronous logging for the render path.
+ *
+ * A message is formatted straight into a slot of a bounded lock-free
+ * multi-producer ring, and a drainer thread writes it to stderr.  The
+ * caller never waits: when the ring is full the message is dropped and
+ * counted.  Before log_start() and after log_stop() messages are
+ * written synchronously instead.
+ *
+ * Every call site is rate limited on its own, to LOG_BURST messages per
+ * LOG_INTERVAL_NS; the next message let through says how many were
+ * suppressed in between.  A missing image retried on every frame thus
+ * logs a handful of lines, not one per frame.
+ */
+#define LOG_BURST 5
+#define LOG_INTERVAL_NS 5000000000ull
+
+enum log_level
+{
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR
+};
+
+struct log_limit
+{
+    std::atomic<uint64_t> start_ns;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> suppressed;
+};
+
+int log_start(void);
+
+/* Write out everything queued and stop the drainer. */
+void log_stop(void);
+
+void log_message(struct log_limit* limit,
+                 enum log_level    level,
+                 const char*       fmt,
+                 ...) __attribute__((format(printf, 3, 4)));
+
+#define LOG_AT(level, ...)                                                    \
+    do                                                                        \
+    {                                                                         \
+        static struct log_limit log_limit_;                                   \
+        log_message(&log_limit_, level, __VA_ARGS__);                         \
+    } while (0)
+
+#define log_info(...) LOG_AT(LOG_INFO, __VA_ARGS__)
+#define log_warning(...) LOG_AT(LOG_WARNING, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+
+#endif /* LOG_H */
@@ -24,24 +24,48 @@
 
 #include "config.h"
 
+/* Ahead of the protocol headers, so that requests get counted. */
+#include "request-stats.h"
+
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 #include <vector>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <png.h>
 #include <wayland-client.h>
 #include <wayland-egl.h>
 
+#include "alpha-modifier-v1-client-protocol.h"
+#include "asset.h"
+#include "event-loop.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "frame-clock.h"
+#include "frame-timings.h"
+#include "log.h"
 #include "os-compatibility.h"
+#include "paint.h"
+#include "perf-counters.h"
+#include "pixel-kernels.h"
+#include "presentation-time-client-protocol.h"
+#include "probes.h"
+#include "shm-allocator.h"
+#include "surface-state.h"
+#include "thread-pool.h"
+#include "trace.h"
+#include "viewporter-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "zalloc.h"
 
@@ -49,345 +73,2000 @@ using namespace std;
 
 struct display
 {
-    struct wl_display*    display;
-    struct wl_registry*   registry;
-    struct wl_compositor* compositor;
-    struct wl_shell*      shell;
-    struct wl_shm*        shm;
-    struct xdg_wm_base*   xdg_shell;
-    bool                  has_xrgb;
+    struct wl_display*           display;
+    struct event_loop*           loop;
+    struct wl_registry*          registry;
+    struct wl_compositor*        compositor;
+    struct wl_subcompositor*     subcompositor;
+    struct wl_shm*               shm;
+    struct xdg_wm_base*          xdg_shell;
+    struct wp_alpha_modifier_v1* alpha_modifier;
+    struct wp_presentation*      presentation;
+    uint32_t                     presentation_clock_id;
+    struct thread_pool*          paint_pool;
+    struct shm_allocator*        shm_allocator;
+    bool                         has_xrgb;
+
+    struct wp_viewporter*                   viewporter;
+    struct wp_fractional_scale_manager_v1* fractional_scale_manager;
+    struct wl_list                          output_list;
+    struct wl_list                          removed_output_list;
+    struct wl_list                          window_list;
+
+    /* Set once startup is done; from then on outputs get overlays. */
+    bool ready;
+};
+
+/*
+ * A wl_output global and the overlays shown on it.  Its events arrive on
+ * the main thread; scale and removed are read by the render threads of
+ * the windows that have entered it.  An unplugged output is parked on
+ * removed_output_list, as those may still point at it.
+ */
+struct output
+{
+    struct display*      display;
+    struct wl_list       link;
+    struct wl_output*    output;
+    uint32_t             name;
+    int32_t              width, height;
+    bool                 done;
+    bool                 has_overlays;
+    std::atomic<int32_t> scale;
+    std::atomic<bool>    removed;
+};
+
+/*
+ * Counters for the stats dump.  The render thread updates them and the
+ * main thread reads them at any time, hence the atomics.  skipped and
+ * missed mirror the frame clock, which only the render thread may read.
+ */
+struct window_stats
+{
+    std::atomic<uint64_t> commits;
+    std::atomic<uint64_t> painted;
+    std::atomic<uint64_t> skipped;
+    std::atomic<uint64_t> missed;
+    std::atomic<uint64_t> stalls;
+    std::atomic<int>      busy;
+};
+
+/* An output a window surface has entered. */
+struct surface_output
+{
+    struct output* output;
+    struct wl_list link;
 };
 
 struct buffer
 {
+    struct window*    window;
     struct wl_buffer* buffer;
     void*             shm_data;
+    int               width, height;
     int               busy;
+
+    /* When the buffer was last committed, 0 once it is released. */
+    uint64_t commit_ns;
+
+    /*
+     * Backing memory, a block of the display's shared pool.  It outlives
+     * the wl_buffer across resizes and only ever grows, so shrinking or
+     * resizing within it costs no new allocation.
+     */
+    struct shm_block block;
 };
 
 struct window
 {
-    struct display*          display;
-    int                      width, height;
-    struct wl_surface*       surface;
-    struct wl_shell_surface* shell_surface;
-    struct xdg_surface*      xdg_surface;
-    struct xdg_toplevel*     xdg_toplevel;
-    struct buffer            buffers[2];
-    struct buffer*           prev_buffer;
-    struct wl_callback*      callback;
+    struct display*      display;
+    struct wl_list       link;
+    struct output*       output;
+    int                  width, height;
+    struct wl_surface*   surface;
+    struct xdg_surface*  xdg_surface;
+    struct xdg_toplevel* xdg_toplevel;
+    struct buffer        buffers[2];
+    struct buffer*       prev_buffer;
+    struct wl_callback*  callback;
+    struct wl_list       element_list;
+
+    /*
+     * In subsurface mode the toplevel only carries a 1x1 transparent
+     * buffer and every element is a desynchronized subsurface with a
+     * buffer of its own.
+     */
+    bool          use_subsurfaces;
+    struct buffer parent_buffer;
+
+    /*
+     * Overall watermark opacity.  With wp_alpha_modifier_v1 it is a
+     * compositor-side multiplier; without it the pixels are scaled
+     * while painting.
+     */
+    double                               opacity;
+    bool                                 opacity_dirty;
+    struct wp_alpha_modifier_surface_v1* alpha_surface;
+
+    /* The opaque region needs to be recomputed for the next commit. */
+    bool                 opaque_dirty;
+    struct surface_state state;
+
+    /*
+     * Frame scheduling.  A wl_surface.frame callback is only requested
+     * while another frame is wanted, and at most one is outstanding.
+     * redraw_waited marks the next frame as one that waited on it.
+     */
+    bool               redraw_pending;
+    bool               redraw_waited;
+    struct frame_clock clock;
+
+    /*
+     * Deadline scheduling.  After a frame callback the paint is held
+     * back on paint_timer until just before the predicted vblank
+     * target_ns; frame_time is the callback time to paint with.
+     */
+    struct event_source* paint_timer;
+    bool                 paint_armed;
+    uint64_t             target_ns;
+    uint32_t             frame_time;
+
+    /* Outstanding wp_presentation_feedback objects, one per commit. */
+    struct wl_list feedback_list;
+
+    /*
+     * Painting runs on a thread of its own.  The surfaces, buffers and
+     * feedback objects deliver their events on queue, which only the
+     * render thread dispatches, so a long repaint never holds up the
+     * pings and configures the main thread handles on the default queue.
+     */
+    struct wl_event_queue* queue;
+    struct event_loop*     render_loop;
+    struct event_source*   render_wakeup;
+    std::atomic<bool>      render_quit;
+    pthread_t              render_thread;
+
+    /*
+     * Configure handshake.  The main thread receives the configure events
+     * and hands the latest one over under configure_mutex; the render
+     * thread applies and acks it.  A burst of resizes is coalesced on
+     * resize_timer so the buffers are only reallocated once it settles.
+     */
+    pthread_mutex_t      configure_mutex;
+    bool                 configure_pending;
+    uint32_t             configure_serial;
+    int                  configure_width, configure_height;
+    int                  toplevel_width, toplevel_height;
+    struct event_source* configure_notify;
+    struct event_source* resize_timer;
+    uint64_t             resize_start_ns;
+    bool                 configured;
+
+    /*
+     * Buffer scale in 120ths.  With wp_fractional_scale_v1 the compositor
+     * tells us the scale, otherwise it is the largest integer scale of the
+     * outputs the surface is on.  The window size and element positions
+     * stay in surface coordinates; only buffers are in device pixels,
+     * mapped back through the viewport when there is one.
+     */
+    int32_t                        scale;
+    struct wp_fractional_scale_v1* fractional_scale;
+    struct wp_viewport*            viewport;
+    struct wl_list                 surface_output_list;
+    struct event_source*           scale_notify;
+
+    /* Opacity animation; fade_start_ns is latched on the first frame. */
+    double   fade_from, fade_to;
+    uint64_t fade_start_ns, fade_duration_ns;
+
+    /*
+     * Per-phase timings.  sample collects the frame being drawn and is
+     * only touched by the render thread; timings is also read by the
+     * main thread when dumping.
+     */
+    struct frame_sample  sample;
+    struct frame_timings timings;
+
+    /*
+     * Set when a redraw found both buffers with the compositor; the
+     * next release picks it up again.
+     */
+    bool                buffer_stalled;
+    struct window_stats stats;
+
+    /* Opened by the render thread with --perf-counters. */
+    struct perf_counters perf;
+};
+
+/* One watermark image placed on the window. */
+struct element
+{
+    struct window*                       window;
+    struct wl_list                       link;
+    char*                                path;
+    int                                  anchor_x, anchor_y;
+    int                                  x, y;
+    bool                                 dirty;
+    bool                                 needs_commit;
+    struct asset*                        asset;
+    struct wl_surface*                   surface;
+    struct wl_subsurface*                subsurface;
+    struct buffer                        buffers[2];
+    struct wp_alpha_modifier_surface_v1* alpha_surface;
+    struct wp_viewport*                  viewport;
+    struct surface_state                 state;
+};
+
+/* Presentation feedback for one commit of the window surface. */
+struct feedback
+{
+    struct window*                   window;
+    struct wl_list                   link;
+    struct wp_presentation_feedback* feedback;
+    uint64_t                         commit_ns;
+    uint64_t                         target_ns;
+    bool                             waited;
+};
+
+/* One watermark image and where it goes, from the command line. */
+struct image_arg
+{
+    char* path;
+    int   x, y;
+};
+
+/*
+ * What an overlay is made of.  Every overlay given on the command line
+ * gets a window on each output.
+ */
+struct overlay_options
+{
+    vector<struct image_arg> images;
+    bool                     use_subsurfaces = false;
+    double                   opacity         = 1.0;
+    uint32_t                 fade_ms         = 0;
+    double                   margin_ms       = -1.0;
 };
 
 static int running = 1;
 
+/* Where --timings writes the phase histograms, on SIGUSR2 and at exit. */
+static const char* timings_path;
+
+/* Where --trace writes the timeline at exit. */
+static const char* trace_path;
+
+/* Where SIGUSR1 appends the stats, stderr without --stats. */
+static const char* stats_path;
+
+static bool use_perf_counters;
+
+/*
+ * CLOCK_MONOTONIC at the top of main(), and when the first painted frame
+ * of any window was committed.
+ */
+static uint64_t              start_ns;
+static std::atomic<uint64_t> first_commit_ns;
+
+static vector<struct overlay_options> overlays;
+
 const int rect_x      = 0;
 const int rect_y      = 0;
 const int rect_width  = 100;
 const int rect_height = 100;
 
-static void redraw(void* data, struct wl_callback* callback, uint32_t time);
+static const char default_image[] = "/home/zwh/Desktop/test.png";
+
+/*
+ * A resize is applied once no other one has arrived for
+ * RESIZE_DEBOUNCE_NS, but never later than RESIZE_MAX_DELAY_NS after the
+ * first one of the burst, so an interactive resize still tracks along.
+ */
+#define RESIZE_DEBOUNCE_NS 30000000ull
+#define RESIZE_MAX_DELAY_NS 200000000ull
+
+/* Window size when there is no output to size it to. */
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+
+static void redraw(struct window* window, uint32_t time);
+static void window_paint_timer(void* data);
+static void render_wakeup(void* data);
+static void window_configure_notify(void* data);
+static void window_resize_timer(void* data);
+static void window_scale_notify(void* data);
+static void window_schedule_redraw(struct window* window);
 
 static void buffer_release(void* data, struct wl_buffer* buffer)
 {
-    struct buffer* mybuf = (struct buffer*)data;
+    struct buffer* mybuf  = (struct buffer*)data;
+    struct window* window = mybuf->window;
 
+    if (mybuf->busy)
+        window->stats.busy--;
     mybuf->busy = 0;
+    trace_instant("wayland", "buffer release", NULL, 0);
+    PROBE2(buffer_release, mybuf, mybuf->commit_ns);
+
+    if (mybuf->commit_ns)
+    {
+        frame_timings_record_phase(&window->timings, FRAME_PHASE_RELEASE,
+                                   frame_clock_now() - mybuf->commit_ns);
+        mybuf->commit_ns = 0;
+    }
+
+    if (window->buffer_stalled)
+    {
+        window->buffer_stalled = false;
+        window_schedule_redraw(window);
+    }
 }
 
 static const struct wl_buffer_listener buffer_listener = {buffer_release};
 
-static int create_shm_buffer(struct display* display,
-                             struct buffer*  buffer,
-                             int             width,
-                             int             height,
-                             uint32_t        format)
+static void set_queue(void* proxy, struct wl_event_queue* queue)
+{
+    wl_proxy_set_queue((struct wl_proxy*)proxy, queue);
+}
+
+/* Make sure the buffer's block holds at least size bytes. */
+static int buffer_reserve(struct window* window, struct buffer* buffer,
+                          size_t size)
 {
-    struct wl_shm_pool* pool;
-    int                 fd, size, stride;
-    void*               data;
+    struct shm_allocator* allocator = window->display->shm_allocator;
+
+    if (size <= buffer->block.size)
+        return 0;
 
-    stride = width * 4;
-    size   = stride * height;
+    shm_allocator_free(allocator, &buffer->block);
+    memset(&buffer->block, 0, sizeof buffer->block);
+    buffer->shm_data = NULL;
 
-    fd = os_create_anonymous_file(size);
-    if (fd < 0)
+    if (shm_allocator_alloc(allocator, size, &buffer->block) < 0)
     {
-        fprintf(stderr, "creating a buffer file for %d B failed: %s\n", size,
-                strerror(errno));
+        log_error("allocating a %zu B buffer failed: %s", size,
+                  strerror(errno));
         return -1;
     }
 
-    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (data == MAP_FAILED)
-    {
-        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
-        close(fd);
+    buffer->shm_data = buffer->block.data;
+
+    return 0;
+}
+
+/*
+ * (Re)create the wl_buffer at the given size, reusing the memory it had
+ * before.  The buffer must not be busy.
+ */
+static int create_shm_buffer(struct window* window,
+                             struct buffer* buffer,
+                             int            width,
+                             int            height,
+                             uint32_t       format)
+{
+    int stride = width * 4;
+
+    if (buffer_reserve(window, buffer, (size_t)stride * height) < 0)
         return -1;
-    }
 
-    pool = wl_shm_create_pool(display->shm, fd, size);
+    if (buffer->buffer)
+        wl_buffer_destroy(buffer->buffer);
+
     buffer->buffer =
-        wl_shm_pool_create_buffer(pool, 0, width, height, stride, format);
+        shm_allocator_create_buffer(window->display->shm_allocator,
+                                    &buffer->block, width, height, stride,
+                                    format);
+    set_queue(buffer->buffer, window->queue);
     wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
-    wl_shm_pool_destroy(pool);
-    close(fd);
 
-    buffer->shm_data = data;
+    buffer->window = window;
+    buffer->width  = width;
+    buffer->height = height;
 
     return 0;
 }
 
+static void destroy_buffer(struct window* window, struct buffer* buffer)
+{
+    if (buffer->buffer)
+        wl_buffer_destroy(buffer->buffer);
+
+    shm_allocator_free(window->display->shm_allocator, &buffer->block);
+
+    memset(buffer, 0, sizeof *buffer);
+}
+
+/*
+ * Runs on the main thread.  The ack is left to the render thread, which
+ * sends it together with the first commit at the new size.
+ */
 static void
 handle_configure(void* data, struct xdg_surface* surface, uint32_t serial)
 {
-    xdg_surface_ack_configure(surface, serial);
+    struct window* window = (struct window*)data;
+
+    trace_instant("wayland", "configure", "serial", serial);
+    PROBE4(configure, window, serial, window->toplevel_width,
+           window->toplevel_height);
+
+    pthread_mutex_lock(&window->configure_mutex);
+    window->configure_pending = true;
+    window->configure_serial  = serial;
+    window->configure_width   = window->toplevel_width;
+    window->configure_height  = window->toplevel_height;
+    pthread_mutex_unlock(&window->configure_mutex);
+
+    event_source_notify(window->configure_notify);
 }
 
 static const struct xdg_surface_listener surface_listener = {
     .configure = handle_configure};
 
+/* Latched by the xdg_surface.configure that follows. */
+static void handle_toplevel_configure(void*                data,
+                                      struct xdg_toplevel* toplevel,
+                                      int32_t              width,
+                                      int32_t              height,
+                                      struct wl_array*     states)
+{
+    struct window* window = (struct window*)data;
+
+    window->toplevel_width  = width;
+    window->toplevel_height = height;
+}
+
+static void handle_toplevel_close(void* data, struct xdg_toplevel* toplevel)
+{
+    running = 0;
+}
+
+static void handle_toplevel_configure_bounds(void*                data,
+                                             struct xdg_toplevel* toplevel,
+                                             int32_t              width,
+                                             int32_t              height)
+{
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    handle_toplevel_configure, handle_toplevel_close,
+    handle_toplevel_configure_bounds};
+
 static void
 handle_ping(void* data, struct xdg_wm_base* xdg_surface, uint32_t serial)
 {
+    trace_instant("wayland", "ping", "serial", serial);
     xdg_wm_base_pong(xdg_surface, serial);
 }
 
 static const struct xdg_wm_base_listener xdg_surface_listener = {handle_ping};
 
-static struct window*
-create_window(struct display* display, int width, int height)
+/*
+ * The device-pixel size of a surface-local length.  Fractional sizes
+ * round half away from zero, as wp_fractional_scale_v1 asks for.
+ */
+static int window_scale_length(struct window* window, int length)
+{
+    return asset_scale_length(length, window->scale);
+}
+
+/*
+ * Describe how a surface of the given size maps its buffer at the window
+ * scale: through the viewport when there is one, otherwise as an integer
+ * buffer scale.
+ */
+static void window_set_surface_scale(struct window*        window,
+                                     struct surface_state* state,
+                                     int                   width,
+                                     int                   height)
+{
+    if (state->viewport)
+        surface_state_set_destination(state, width, height);
+    else
+        surface_state_set_scale(state, window->scale / ASSET_SCALE_1);
+}
+
+static void window_set_scale(struct window* window, int32_t scale)
+{
+    struct element* element;
+
+    if (scale <= 0 || scale == window->scale)
+        return;
+
+    window->scale = scale;
+    wl_list_for_each(element, &window->element_list, link)
+        element->dirty = true;
+    window->opaque_dirty = true;
+
+    if (window->configured)
+        window_schedule_redraw(window);
+}
+
+/*
+ * Without fractional scaling follow the highest integer scale among the
+ * outputs the surface is on.  Off every output the last scale is kept.
+ */
+static void window_update_output_scale(struct window* window)
+{
+    struct surface_output* so;
+    int32_t                scale = 0;
+
+    if (window->fractional_scale)
+        return;
+
+    wl_list_for_each(so, &window->surface_output_list, link)
+    {
+        if (!so->output->removed)
+            scale = std::max(scale, so->output->scale.load());
+    }
+
+    if (scale > 0)
+        window_set_scale(window, scale * ASSET_SCALE_1);
+}
+
+static void window_scale_notify(void* data)
+{
+    window_update_output_scale((struct window*)data);
+}
+
+static void surface_enter(void*              data,
+                          struct wl_surface* surface,
+                          struct wl_output*  wl_output)
+{
+    struct window*         window = (struct window*)data;
+    struct surface_output* so;
+
+    if (!wl_output)
+        return;
+
+    so = (struct surface_output*)zalloc(sizeof *so);
+    if (!so)
+        return;
+
+    so->output = (struct output*)wl_output_get_user_data(wl_output);
+    wl_list_insert(&window->surface_output_list, &so->link);
+    window_update_output_scale(window);
+}
+
+static void surface_leave(void*              data,
+                          struct wl_surface* surface,
+                          struct wl_output*  wl_output)
+{
+    struct window*        window = (struct window*)data;
+    struct surface_output *so, *tmp;
+    struct output*        output;
+
+    /* The output may already be gone. */
+    if (!wl_output)
+        return;
+
+    output = (struct output*)wl_output_get_user_data(wl_output);
+    wl_list_for_each_safe(so, tmp, &window->surface_output_list, link)
+    {
+        if (so->output != output)
+            continue;
+
+        wl_list_remove(&so->link);
+        free(so);
+    }
+    window_update_output_scale(window);
+}
+
+static const struct wl_surface_listener window_surface_listener = {
+    .enter = surface_enter, .leave = surface_leave};
+
+static void fractional_preferred_scale(
+    void* data, struct wp_fractional_scale_v1* fractional_scale, uint32_t scale)
+{
+    window_set_scale((struct window*)data, scale);
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener =
+    {fractional_preferred_scale};
+
+/* Surface coordinate of a device one, rounded up or down. */
+static int surface_coord(int  device,
+                         int  surface_size,
+                         int  buffer_size,
+                         bool round_up)
+{
+    int64_t n = (int64_t)device * surface_size;
+    int64_t q = n / buffer_size, r = n % buffer_size;
+
+    /* elements can hang off the top and left edges */
+    if (r < 0)
+    {
+        q--;
+        r += buffer_size;
+    }
+
+    return (int)(round_up && r ? q + 1 : q);
+}
+
+/*
+ * Add the opaque rects of a scaled asset painted at (x, y) of a
+ * buffer_width x buffer_height buffer, which a surface_width x
+ * surface_height surface shows.  Rounding inward keeps every surface
+ * pixel of the region over fully opaque device pixels.
+ */
+static void region_add_opaque_rects(struct region_state* region,
+                                    const struct asset*  scaled,
+                                    int                  x,
+                                    int                  y,
+                                    int                  surface_width,
+                                    int                  surface_height,
+                                    int                  buffer_width,
+                                    int                  buffer_height)
+{
+    int x0, y0, x1, y1;
+
+    for (int i = 0; i < scaled->n_opaque_rects; i++)
+    {
+        const struct asset_rect* r = &scaled->opaque_rects[i];
+
+        x0 = surface_coord(x + r->x, surface_width, buffer_width, true);
+        y0 = surface_coord(y + r->y, surface_height, buffer_height, true);
+        x1 = surface_coord(x + r->x + r->width, surface_width, buffer_width,
+                           false);
+        y1 = surface_coord(y + r->y + r->height, surface_height,
+                           buffer_height, false);
+        if (x1 > x0 && y1 > y0)
+            region_state_add(region, x0, y0, x1 - x0, y1 - y0);
+    }
+}
+
+/*
+ * The toplevel state, declared again on every frame.  A window that
+ * belongs to an output covers it fullscreen, otherwise it is maximized
+ * wherever the compositor puts it.
+ */
+static void window_declare_state(struct window* window)
+{
+    surface_state_set_parent(&window->state, NULL);
+    surface_state_set_maximized(&window->state, !window->output);
+    surface_state_set_fullscreen(&window->state, window->output != NULL,
+                                 window->output ? window->output->output :
+                                                  NULL);
+}
+
+static struct window* create_window(struct display* display,
+                                    struct output*  output,
+                                    int             width,
+                                    int             height)
 {
-    struct window*    window = NULL;
-    struct wl_region* region = NULL;
+    struct window* window = NULL;
 
     window = (struct window*)zalloc(sizeof *window);
     if (!window)
         return NULL;
 
-    window->callback = NULL;
-    window->display  = display;
-    window->width    = width;
-    window->height   = height;
-    window->surface  = wl_compositor_create_surface(display->compositor);
+    window->callback     = NULL;
+    window->display      = display;
+    window->output       = output;
+    window->width        = width;
+    window->height       = height;
+    window->scale        = ASSET_SCALE_1;
+    window->opacity      = 1.0;
+    window->opaque_dirty = true;
+    frame_clock_init(&window->clock);
+    frame_timings_init(&window->timings);
+    perf_counters_init(&window->perf);
+    wl_list_init(&window->element_list);
+    wl_list_init(&window->feedback_list);
+    wl_list_init(&window->surface_output_list);
+
+    window->queue       = wl_display_create_queue(display->display);
+    window->render_loop = event_loop_create();
+    if (!window->queue || !window->render_loop ||
+        event_loop_add_display(window->render_loop, display->display,
+                               window->queue) < 0)
+    {
+        if (window->render_loop)
+            event_loop_destroy(window->render_loop);
+        if (window->queue)
+            wl_event_queue_destroy(window->queue);
+        frame_timings_release(&window->timings);
+        perf_counters_release(&window->perf);
+        free(window);
+        return NULL;
+    }
+    window->paint_timer =
+        event_loop_add_timer(window->render_loop, window_paint_timer, window);
+    window->render_wakeup =
+        event_loop_add_notify(window->render_loop, render_wakeup, window);
+    window->configure_notify = event_loop_add_notify(
+        window->render_loop, window_configure_notify, window);
+    window->resize_timer =
+        event_loop_add_timer(window->render_loop, window_resize_timer, window);
+    window->scale_notify = event_loop_add_notify(
+        window->render_loop, window_scale_notify, window);
+    pthread_mutex_init(&window->configure_mutex, NULL);
+
+    window->surface = wl_compositor_create_surface(display->compositor);
+    set_queue(window->surface, window->queue);
+    wl_surface_add_listener(window->surface, &window_surface_listener, window);
     window->xdg_surface =
         xdg_wm_base_get_xdg_surface(display->xdg_shell, window->surface);
     if (window->xdg_surface)
-        xdg_surface_add_listener(window->xdg_surface, &surface_listener, NULL);
-
-    if (display->xdg_shell)
-        xdg_wm_base_add_listener(display->xdg_shell, &xdg_surface_listener,
-                                 NULL);
+        xdg_surface_add_listener(window->xdg_surface, &surface_listener,
+                                 window);
 
     window->xdg_toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+    xdg_toplevel_add_listener(window->xdg_toplevel, &toplevel_listener,
+                              window);
+
+    /* Sent with the first commit; the overlay never takes input. */
+    surface_state_init(&window->state, display->compositor, window->surface,
+                       window->xdg_toplevel);
+    window_declare_state(window);
+    region_state_reset(&window->state.input, true);
 
-    xdg_toplevel_set_parent(window->xdg_toplevel, NULL);
-    xdg_toplevel_set_maximized(window->xdg_toplevel);
+    if (display->alpha_modifier)
+        window->alpha_surface = wp_alpha_modifier_v1_get_surface(
+            display->alpha_modifier, window->surface);
 
-    region = wl_compositor_create_region(display->compositor);
-    wl_region_add(region, 0, 0, 0, 0);
-    wl_surface_set_input_region(window->surface, region);
-    wl_region_destroy(region);
+    /* Fractional scales can only be presented through a viewport. */
+    if (display->viewporter)
+    {
+        window->viewport =
+            wp_viewporter_get_viewport(display->viewporter, window->surface);
+        surface_state_set_viewport(&window->state, window->viewport);
+    }
+    if (display->viewporter && display->fractional_scale_manager)
+    {
+        window->fractional_scale =
+            wp_fractional_scale_manager_v1_get_fractional_scale(
+                display->fractional_scale_manager, window->surface);
+        set_queue(window->fractional_scale, window->queue);
+        wp_fractional_scale_v1_add_listener(window->fractional_scale,
+                                            &fractional_scale_listener, window);
+    }
+
+    wl_list_insert(&display->window_list, &window->link);
 
     return window;
 }
 
+static struct element*
+window_add_element(struct window* window, const char* path, int x, int y)
+{
+    struct display* display = window->display;
+    struct element* element;
+
+    element = (struct element*)zalloc(sizeof *element);
+    if (!element)
+        return NULL;
+
+    element->window   = window;
+    element->path     = strdup(path);
+    element->anchor_x = x;
+    element->anchor_y = y;
+    element->x        = x;
+    element->y        = y;
+    element->dirty    = true;
+    wl_list_insert(window->element_list.prev, &element->link);
+
+    if (!window->use_subsurfaces)
+        return element;
+
+    element->surface = wl_compositor_create_surface(display->compositor);
+    set_queue(element->surface, window->queue);
+    element->subsurface = wl_subcompositor_get_subsurface(
+        display->subcompositor, element->surface, window->surface);
+    wl_subsurface_set_position(element->subsurface, x, y);
+    wl_subsurface_set_desync(element->subsurface);
+
+    /* Subsurfaces default to an infinite input region. */
+    surface_state_init(&element->state, display->compositor, element->surface,
+                       NULL);
+    region_state_reset(&element->state.input, true);
+
+    if (display->alpha_modifier)
+        element->alpha_surface = wp_alpha_modifier_v1_get_surface(
+            display->alpha_modifier, element->surface);
+
+    if (display->viewporter)
+    {
+        element->viewport =
+            wp_viewporter_get_viewport(display->viewporter, element->surface);
+        surface_state_set_viewport(&element->state, element->viewport);
+    }
+
+    return element;
+}
+
+static void destroy_element(struct element* element)
+{
+    destroy_buffer(element->window, &element->buffers[0]);
+    destroy_buffer(element->window, &element->buffers[1]);
+
+    if (element->alpha_surface)
+        wp_alpha_modifier_surface_v1_destroy(element->alpha_surface);
+    if (element->viewport)
+        wp_viewport_destroy(element->viewport);
+    if (element->subsurface)
+        wl_subsurface_destroy(element->subsurface);
+    if (element->surface)
+        wl_surface_destroy(element->surface);
+
+    surface_state_release(&element->state);
+    wl_list_remove(&element->link);
+    free(element->path);
+    free(element);
+}
+
+static void destroy_feedback(struct feedback* feedback)
+{
+    wp_presentation_feedback_destroy(feedback->feedback);
+    wl_list_remove(&feedback->link);
+    free(feedback);
+}
+
 static void destroy_window(struct window* window)
 {
+    struct element        *element, *tmp;
+    struct feedback       *feedback, *ftmp;
+    struct surface_output *so, *stmp;
+
     if (window->callback)
         wl_callback_destroy(window->callback);
 
-    if (window->buffers[0].buffer)
-        wl_buffer_destroy(window->buffers[0].buffer);
-    if (window->buffers[1].buffer)
-        wl_buffer_destroy(window->buffers[1].buffer);
+    wl_list_for_each_safe(so, stmp, &window->surface_output_list, link)
+    {
+        wl_list_remove(&so->link);
+        free(so);
+    }
+
+    wl_list_for_each_safe(feedback, ftmp, &window->feedback_list, link)
+        destroy_feedback(feedback);
 
+    wl_list_for_each_safe(element, tmp, &window->element_list, link)
+        destroy_element(element);
+
+    destroy_buffer(window, &window->buffers[0]);
+    destroy_buffer(window, &window->buffers[1]);
+    destroy_buffer(window, &window->parent_buffer);
+
+    if (window->alpha_surface)
+        wp_alpha_modifier_surface_v1_destroy(window->alpha_surface);
+    if (window->fractional_scale)
+        wp_fractional_scale_v1_destroy(window->fractional_scale);
+    if (window->viewport)
+        wp_viewport_destroy(window->viewport);
+
+    xdg_toplevel_destroy(window->xdg_toplevel);
     xdg_surface_destroy(window->xdg_surface);
-    wl_shell_surface_destroy(window->shell_surface);
     wl_surface_destroy(window->surface);
+
+    event_loop_destroy(window->render_loop);
+    wl_event_queue_destroy(window->queue);
+    surface_state_release(&window->state);
+    pthread_mutex_destroy(&window->configure_mutex);
+    frame_timings_release(&window->timings);
+    perf_counters_release(&window->perf);
+    wl_list_remove(&window->link);
     free(window);
 }
 
-static struct buffer* window_next_buffer(struct window* window)
+static struct buffer* window_next_buffer(struct window* window)
+{
+    struct buffer* buffer = NULL;
+    int            width  = window_scale_length(window, window->width);
+    int            height = window_scale_length(window, window->height);
+    int            ret    = 0;
+
+    if (!window->buffers[0].busy)
+        buffer = &window->buffers[0];
+    else if (!window->buffers[1].busy)
+        buffer = &window->buffers[1];
+    else
+    {
+        PROBE1(buffer_stall, window);
+        window->stats.stalls++;
+        return NULL;
+    }
+
+    /* After a resize each buffer is recreated once it is released. */
+    if (!buffer->buffer || buffer->width != width || buffer->height != height)
+    {
+        ret = create_shm_buffer(window, buffer, width, height,
+                                WL_SHM_FORMAT_ARGB8888);
+        if (ret < 0)
+            return NULL;
+    }
+    PROBE4(buffer_acquire, window, buffer, width, height);
+
+    return buffer;
+}
+
+/*
+ * The alpha painted into the buffers.  When the compositor applies the
+ * opacity for us the pixels are left untouched.
+ */
+static uint32_t window_paint_alpha(struct window* window)
+{
+    if (window->display->alpha_modifier)
+        return 255;
+
+    return (uint32_t)(window->opacity * 255.0 + 0.5);
+}
+
+static void paint_pixels(struct window* window,
+                         void*          image,
+                         int            width,
+                         int            height,
+                         uint32_t       time)
+{
+    vector<struct paint_layer> layers;
+    struct element*            element;
+    struct asset*              asset;
+    struct paint_timings       timings;
+    uint64_t                   start = frame_clock_now();
+
+    trace_begin("frame", "decode");
+
+    /*
+     * Decoding is not thread safe, resolve the assets before painting.
+     * The unscaled asset describes the element in surface coordinates,
+     * the scaled one is what gets painted.
+     */
+    wl_list_for_each(element, &window->element_list, link)
+    {
+        asset = asset_cache_get(element->path);
+        if (asset != element->asset)
+        {
+            element->asset       = asset;
+            window->opaque_dirty = true;
+        }
+        if (!asset)
+            continue;
+
+        asset = asset_cache_get_scaled(element->path, window->scale);
+        if (!asset)
+            continue;
+
+        layers.push_back({asset, window_scale_length(window, element->x),
+                          window_scale_length(window, element->y)});
+    }
+    frame_sample_add(&window->sample, FRAME_PHASE_DECODE,
+                     frame_clock_now() - start);
+    perf_counters_mark(&window->perf, PERF_PHASE_DECODE);
+    trace_end("frame", "decode");
+
+    timings.clear_ns = 0;
+    timings.blit_ns  = 0;
+    trace_begin("frame", "paint");
+    paint_surface(window->display->paint_pool, (uint32_t*)image, width,
+                  height, layers.data(), layers.size(),
+                  window_paint_alpha(window), &timings);
+    perf_counters_mark(&window->perf, PERF_PHASE_PAINT);
+    trace_end("frame", "paint");
+    frame_sample_add(&window->sample, FRAME_PHASE_CLEAR, timings.clear_ns);
+    frame_sample_add(&window->sample, FRAME_PHASE_CONVERT, timings.blit_ns);
+}
+
+static struct buffer*
+element_next_buffer(struct element* element, int width, int height)
+{
+    struct buffer* buffer = NULL;
+    int            ret    = 0;
+
+    if (!element->buffers[0].busy)
+        buffer = &element->buffers[0];
+    else if (!element->buffers[1].busy)
+        buffer = &element->buffers[1];
+    else
+        return NULL;
+
+    if (!buffer->buffer || buffer->width != width || buffer->height != height)
+    {
+        ret = create_shm_buffer(element->window, buffer, width, height,
+                                WL_SHM_FORMAT_ARGB8888);
+        if (ret < 0)
+            return NULL;
+    }
+
+    return buffer;
+}
+
+/*
+ * Publish the opaque parts of an element surface so the compositor can
+ * skip blending whatever lies underneath them.  Anything drawn with an
+ * opacity below 1 has no opaque pixels at all.
+ */
+static void element_update_opaque_region(struct element* element)
+{
+    struct window* window = element->window;
+    struct asset*  scaled = NULL;
+
+    if (element->asset && window->opacity >= 1.0)
+        scaled = asset_cache_get_scaled(element->path, window->scale);
+
+    region_state_reset(&element->state.opaque, false);
+    if (scaled)
+        region_add_opaque_rects(&element->state.opaque, scaled, 0, 0,
+                                element->asset->width, element->asset->height,
+                                scaled->width, scaled->height);
+
+    element->needs_commit = true;
+}
+
+/*
+ * Same for the single-surface layout.  Elements are copied over each
+ * other in list order, so every element first removes its whole
+ * rectangle from what the elements below it made opaque.
+ */
+static void window_update_opaque_region(struct window* window)
+{
+    struct region_state* region = &window->state.opaque;
+    struct element*      element;
+    struct asset*        scaled;
+
+    if (!window->opaque_dirty)
+        return;
+
+    region_state_reset(region, window->opacity >= 1.0);
+    if (window->opacity >= 1.0)
+    {
+        wl_list_for_each(element, &window->element_list, link)
+        {
+            if (!element->asset)
+                continue;
+
+            region_state_subtract(region, element->x, element->y,
+                                  element->asset->width,
+                                  element->asset->height);
+
+            /* placed where paint_pixels() puts it */
+            scaled = asset_cache_get_scaled(element->path, window->scale);
+            if (scaled)
+                region_add_opaque_rects(
+                    region, scaled, window_scale_length(window, element->x),
+                    window_scale_length(window, element->y), window->width,
+                    window->height, window_scale_length(window, window->width),
+                    window_scale_length(window, window->height));
+        }
+    }
+
+    window->opaque_dirty = false;
+}
+
+/*
+ * Upload an element's image to its own subsurface.  Only this element's
+ * buffer is touched; the toplevel and the other elements are left alone.
+ */
+static int element_update(struct element* element)
+{
+    struct window* window = element->window;
+    struct asset  *asset, *scaled;
+    struct buffer* buffer;
+    uint64_t       start, now;
+
+    start = frame_clock_now();
+    asset = asset_cache_get(element->path);
+    if (!asset)
+        return -1;
+
+    if (asset != element->asset)
+    {
+        element->asset = asset;
+        element_update_opaque_region(element);
+    }
+
+    scaled = asset_cache_get_scaled(element->path, window->scale);
+    if (!scaled)
+        return -1;
+
+    now = frame_clock_now();
+    frame_sample_add(&window->sample, FRAME_PHASE_DECODE, now - start);
+    perf_counters_mark(&window->perf, PERF_PHASE_DECODE);
+    start = now;
+
+    buffer = element_next_buffer(element, scaled->width, scaled->height);
+    if (!buffer)
+        return -1;
+
+    now = frame_clock_now();
+    frame_sample_add(&window->sample, FRAME_PHASE_ACQUIRE, now - start);
+    perf_counters_mark(&window->perf, PERF_PHASE_ACQUIRE);
+    start = now;
+
+    pixel_scale_alpha((uint32_t*)buffer->shm_data, scaled->pixels,
+                      scaled->width * scaled->height,
+                      window_paint_alpha(window));
+
+    now = frame_clock_now();
+    frame_sample_add(&window->sample, FRAME_PHASE_CONVERT, now - start);
+    perf_counters_mark(&window->perf, PERF_PHASE_PAINT);
+    start = now;
+
+    wl_surface_attach(element->surface, buffer->buffer, 0, 0);
+    wl_surface_damage(element->surface, 0, 0, asset->width, asset->height);
+    window_set_surface_scale(window, &element->state, asset->width,
+                             asset->height);
+    surface_state_flush(&element->state);
+    wl_surface_commit(element->surface);
+    buffer->busy          = 1;
+    element->dirty        = false;
+    element->needs_commit = false;
+    window->stats.busy++;
+    window->stats.painted++;
+
+    now               = frame_clock_now();
+    buffer->commit_ns = now;
+    frame_sample_add(&window->sample, FRAME_PHASE_SUBMIT, now - start);
+    perf_counters_mark(&window->perf, PERF_PHASE_SUBMIT);
+
+    return 0;
+}
+
+/*
+ * Move an element.  In subsurface mode this is a pure compositor-side
+ * operation: the subsurface position is latched on the next commit of
+ * the parent surface and no pixels are re-uploaded.
+ */
+static void element_move(struct element* element, int x, int y)
+{
+    struct window* window = element->window;
+
+    if (element->x == x && element->y == y)
+        return;
+
+    element->x = x;
+    element->y = y;
+
+    if (window->use_subsurfaces)
+    {
+        wl_subsurface_set_position(element->subsurface, x, y);
+    }
+    else
+    {
+        element->dirty       = true;
+        window->opaque_dirty = true;
+    }
+}
+
+/*
+ * Resolve element anchors against the window size.  Negative
+ * coordinates are offsets from the right and bottom edges.
+ */
+static void window_layout_elements(struct window* window)
+{
+    struct element* element;
+    struct asset*   asset;
+    int             x, y;
+
+    wl_list_for_each(element, &window->element_list, link)
+    {
+        x = element->anchor_x;
+        y = element->anchor_y;
+
+        if (x < 0 || y < 0)
+        {
+            asset = asset_cache_get(element->path);
+            if (!asset)
+                continue;
+
+            if (x < 0)
+                x += window->width - asset->width;
+            if (y < 0)
+                y += window->height - asset->height;
+        }
+
+        element_move(element, x, y);
+    }
+}
+
+static void window_set_opacity(struct window* window, double opacity)
+{
+    struct element* element;
+
+    if (opacity < 0.0)
+        opacity = 0.0;
+    if (opacity > 1.0)
+        opacity = 1.0;
+    if (opacity == window->opacity)
+        return;
+
+    window->opacity      = opacity;
+    window->opaque_dirty = true;
+
+    if (window->display->alpha_modifier)
+    {
+        window->opacity_dirty = true;
+        return;
+    }
+
+    wl_list_for_each(element, &window->element_list, link)
+        element->dirty = true;
+}
+
+/*
+ * Send the pending opacity as a single set_multiplier request per
+ * surface.  It is latched by the commit that follows.
+ */
+static void window_apply_opacity(struct window* window)
+{
+    struct element* element;
+    uint32_t        factor;
+
+    if (!window->opacity_dirty)
+        return;
+
+    factor = (uint32_t)(window->opacity * (double)UINT32_MAX);
+
+    if (!window->use_subsurfaces)
+    {
+        wp_alpha_modifier_surface_v1_set_multiplier(window->alpha_surface,
+                                                    factor);
+    }
+    else
+    {
+        wl_list_for_each(element, &window->element_list, link)
+        {
+            wp_alpha_modifier_surface_v1_set_multiplier(
+                element->alpha_surface, factor);
+            element->needs_commit = true;
+        }
+    }
+
+    window->opacity_dirty = false;
+}
+
+/*
+ * Start fading to the given opacity.  The animation runs off frame
+ * callbacks, starting with the next frame.
+ */
+static void
+window_fade_to(struct window* window, double opacity, uint32_t duration_ms)
+{
+    window->fade_from        = window->opacity;
+    window->fade_to          = opacity;
+    window->fade_start_ns    = 0;
+    window->fade_duration_ns = (uint64_t)duration_ms * 1000000;
+}
+
+/* Advance animations, asking for another frame while one is running. */
+static void window_animate(struct window* window, uint64_t now)
+{
+    double t;
+
+    if (!window->fade_duration_ns)
+        return;
+
+    if (!window->fade_start_ns)
+        window->fade_start_ns = now;
+
+    t = (double)(now - window->fade_start_ns) / window->fade_duration_ns;
+    if (t >= 1.0)
+    {
+        window_set_opacity(window, window->fade_to);
+        window->fade_duration_ns = 0;
+        return;
+    }
+
+    window_set_opacity(window,
+                       window->fade_from +
+                           (window->fade_to - window->fade_from) * t);
+    window->redraw_pending = true;
+}
+
+static bool window_needs_paint(struct window* window)
+{
+    struct element* element;
+
+    wl_list_for_each(element, &window->element_list, link)
+    {
+        if (element->dirty)
+            return true;
+    }
+
+    return false;
+}
+
+static void redraw_subsurfaces(struct window* window)
+{
+    struct element* element;
+
+    if (!window->parent_buffer.buffer)
+    {
+        if (create_shm_buffer(window, &window->parent_buffer, 1, 1,
+                              WL_SHM_FORMAT_ARGB8888) < 0)
+        {
+            fprintf(stderr, "Failed to create the parent buffer.\n");
+            abort();
+        }
+
+        *(uint32_t*)window->parent_buffer.shm_data = 0x00000000;
+        wl_surface_attach(window->surface, window->parent_buffer.buffer, 0, 0);
+        wl_surface_damage(window->surface, 0, 0, 1, 1);
+    }
+
+    window_apply_opacity(window);
+
+    wl_list_for_each(element, &window->element_list, link)
+    {
+        if (window->opaque_dirty && element->asset)
+            element_update_opaque_region(element);
+
+        if (element->dirty)
+            element_update(element);
+
+        if (element->needs_commit)
+        {
+            surface_state_flush(&element->state);
+            wl_surface_commit(element->surface);
+            element->needs_commit = false;
+        }
+    }
+    window->opaque_dirty = false;
+}
+
+/* Returns the buffer attached for the commit, if any. */
+static struct buffer* redraw_single(struct window* window, uint32_t time)
+{
+    struct buffer*  buffer;
+    struct element* element;
+    uint64_t        start;
+
+    /* A compositor-side opacity change alone needs no new buffer. */
+    if (window->prev_buffer && !window_needs_paint(window))
+    {
+        window_apply_opacity(window);
+        window_update_opaque_region(window);
+        return NULL;
+    }
+
+    trace_begin("frame", "acquire");
+    start  = frame_clock_now();
+    buffer = window_next_buffer(window);
+    trace_end("frame", "acquire");
+    if (!buffer && !window->prev_buffer)
+    {
+        fprintf(stderr, "Failed to create the first buffer.\n");
+        abort();
+    }
+    if (!buffer)
+    {
+        /* The compositor holds both, paint once one comes back. */
+        window->buffer_stalled = true;
+        return NULL;
+    }
+    frame_sample_add(&window->sample, FRAME_PHASE_ACQUIRE,
+                     frame_clock_now() - start);
+    perf_counters_mark(&window->perf, PERF_PHASE_ACQUIRE);
+
+    paint_pixels(window, buffer->shm_data, buffer->width, buffer->height,
+                 time);
+    wl_list_for_each(element, &window->element_list, link)
+    {
+        if (element->asset)
+            element->dirty = false;
+    }
+
+    trace_begin("frame", "submit");
+    start = frame_clock_now();
+    wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+    wl_surface_damage(window->surface, 0, 0, window->width, window->height);
+    window_set_surface_scale(window, &window->state, window->width,
+                             window->height);
+    window_apply_opacity(window);
+    window_update_opaque_region(window);
+
+    buffer->busy        = 1;
+    window->prev_buffer = buffer;
+    window->stats.busy++;
+    window->stats.painted++;
+    frame_sample_add(&window->sample, FRAME_PHASE_SUBMIT,
+                     frame_clock_now() - start);
+    trace_end("frame", "submit");
+
+    return buffer;
+}
+
+/*
+ * Start the paint as late as possible: the predicted vblank minus the
+ * expected paint time and the safety margin.  Without a refresh estimate
+ * (no wp_presentation, or no feedback yet) paint right away.
+ */
+static void window_arm_paint(struct window* window, uint32_t time)
+{
+    uint64_t now, deadline;
+
+    now      = frame_clock_now();
+    deadline = frame_clock_paint_deadline(&window->clock, now,
+                                          &window->target_ns);
+    if (!window->paint_timer || deadline <= now ||
+        event_source_timer_update(window->paint_timer, deadline) < 0)
+    {
+        redraw(window, time);
+        return;
+    }
+
+    window->frame_time  = time;
+    window->paint_armed = true;
+}
+
+static void window_paint_timer(void* data)
+{
+    struct window* window = (struct window*)data;
+
+    window->paint_armed = false;
+    redraw(window, window->frame_time);
+}
+
+static void frame_done(void* data, struct wl_callback* callback, uint32_t time)
+{
+    struct window* window = (struct window*)data;
+
+    assert(callback == window->callback);
+    wl_callback_destroy(callback);
+    window->callback = NULL;
+
+    trace_instant("wayland", "frame done", "time", time);
+    frame_clock_frame_done(&window->clock, frame_clock_now());
+
+    if (window->redraw_pending)
+    {
+        window->redraw_waited = true;
+        window_arm_paint(window, time);
+    }
+}
+
+static const struct wl_callback_listener frame_listener = {frame_done};
+
+static void feedback_sync_output(void*                            data,
+                                 struct wp_presentation_feedback* feedback,
+                                 struct wl_output*                output)
+{
+}
+
+/*
+ * The presentation timestamp is on the compositor's clock; bring it onto
+ * CLOCK_MONOTONIC so it can be compared with the commit time.
+ */
+static void feedback_presented(void*                            data,
+                               struct wp_presentation_feedback* wp_feedback,
+                               uint32_t                         tv_sec_hi,
+                               uint32_t                         tv_sec_lo,
+                               uint32_t                         tv_nsec,
+                               uint32_t                         refresh,
+                               uint32_t                         seq_hi,
+                               uint32_t                         seq_lo,
+                               uint32_t                         flags)
+{
+    struct feedback* feedback = (struct feedback*)data;
+    struct window*   window   = feedback->window;
+    uint64_t         present_ns;
+
+    present_ns =
+        (((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000ull + tv_nsec;
+    present_ns = frame_clock_to_monotonic(
+        window->display->presentation_clock_id, present_ns);
+
+    trace_instant("wayland", "presented", "seq",
+                  ((uint64_t)seq_hi << 32) | seq_lo);
+    frame_clock_presented(&window->clock, feedback->commit_ns,
+                          feedback->target_ns, present_ns, refresh,
+                          ((uint64_t)seq_hi << 32) | seq_lo,
+                          feedback->waited);
+    window->stats.skipped = window->clock.skipped;
+    window->stats.missed  = window->clock.missed;
+    destroy_feedback(feedback);
+}
+
+static void feedback_discarded(void*                            data,
+                               struct wp_presentation_feedback* wp_feedback)
+{
+    struct feedback* feedback = (struct feedback*)data;
+
+    trace_instant("wayland", "discarded", NULL, 0);
+    frame_clock_discarded(&feedback->window->clock);
+    destroy_feedback(feedback);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    feedback_sync_output, feedback_presented, feedback_discarded};
+
+/* Ask for presentation feedback on the commit that is about to be made. */
+static struct feedback* window_request_feedback(struct window* window)
+{
+    struct feedback* feedback;
+
+    if (!window->display->presentation)
+        return NULL;
+
+    feedback = (struct feedback*)zalloc(sizeof *feedback);
+    if (!feedback)
+        return NULL;
+
+    feedback->window   = window;
+    feedback->feedback = wp_presentation_feedback(
+        window->display->presentation, window->surface);
+    set_queue(feedback->feedback, window->queue);
+    wp_presentation_feedback_add_listener(feedback->feedback,
+                                          &feedback_listener, feedback);
+    wl_list_insert(&window->feedback_list, &feedback->link);
+
+    return feedback;
+}
+
+static void redraw(struct window* window, uint32_t time)
+{
+    struct feedback* feedback;
+    struct buffer*   buffer = NULL;
+    uint64_t         start, now;
+
+    trace_begin("frame", "redraw");
+    PROBE3(paint_start, window, window->width, window->height);
+    perf_counters_start(&window->perf);
+    window->redraw_pending = false;
+    start                  = frame_clock_now();
+    window_animate(window, start);
+
+    if (window->use_subsurfaces)
+        redraw_subsurfaces(window);
+    else
+        buffer = redraw_single(window, time);
+
+    now = frame_clock_now();
+    frame_clock_paint_time(&window->clock, now - start);
+    PROBE2(paint_end, window, now - start);
+    start = now;
+
+    /*
+     * The toplevel state is declared on every frame, the state cache
+     * only sends it when it actually changes.
+     */
+    window_declare_state(window);
+
+    /* Only ask for a frame callback when there is a next frame to draw. */
+    if (window->redraw_pending && !window->callback)
+    {
+        window->callback = wl_surface_frame(window->surface);
+        wl_callback_add_listener(window->callback, &frame_listener, window);
+    }
+
+    trace_begin("frame", "commit");
+    surface_state_flush(&window->state);
+    feedback = window_request_feedback(window);
+    wl_surface_commit(window->surface);
+    trace_end("frame", "commit");
+
+    now = frame_clock_now();
+    if (feedback)
+    {
+        feedback->commit_ns = now;
+        feedback->target_ns = window->target_ns;
+        feedback->waited    = window->redraw_waited;
+    }
+    window->target_ns     = 0;
+    window->redraw_waited = false;
+    frame_clock_committed(&window->clock, now);
+
+    if (buffer)
+        buffer->commit_ns = now;
+    if (!first_commit_ns.load(std::memory_order_relaxed))
+    {
+        uint64_t none = 0;
+
+        if (first_commit_ns.compare_exchange_strong(none, now))
+            trace_instant("startup", "first commit", NULL, 0);
+    }
+    PROBE3(commit, window, buffer, window->clock.frames);
+    window->stats.commits++;
+    frame_sample_add(&window->sample, FRAME_PHASE_SUBMIT, now - start);
+    frame_timings_record(&window->timings, &window->sample);
+    perf_counters_mark(&window->perf, PERF_PHASE_SUBMIT);
+    perf_counters_commit(&window->perf);
+    trace_end("frame", "redraw");
+}
+
+/*
+ * Ask for a new frame.  While a frame callback or the paint timer is
+ * outstanding the frame is drawn when it fires; otherwise the loop is
+ * idle and we draw now.
+ */
+static void window_schedule_redraw(struct window* window)
+{
+    window->redraw_pending = true;
+
+    if (!window->callback && !window->paint_armed)
+        redraw(window, 0);
+}
+
+/*
+ * Take the configure handed over by the main thread: adopt its size,
+ * ack it and draw the frame that goes with the ack.  A size of 0 leaves
+ * the choice to us, so the current size is kept.
+ */
+static void window_apply_configure(struct window* window)
+{
+    struct element* element;
+    uint32_t        serial;
+    int             width, height;
+
+    pthread_mutex_lock(&window->configure_mutex);
+    if (!window->configure_pending)
+    {
+        pthread_mutex_unlock(&window->configure_mutex);
+        return;
+    }
+    window->configure_pending = false;
+    serial                    = window->configure_serial;
+    width                     = window->configure_width;
+    height                    = window->configure_height;
+    pthread_mutex_unlock(&window->configure_mutex);
+
+    event_source_timer_update(window->resize_timer, 0);
+    window->resize_start_ns = 0;
+
+    if (width > 0 && height > 0 &&
+        (width != window->width || height != window->height))
+    {
+        window->width  = width;
+        window->height = height;
+        window_layout_elements(window);
+
+        /* The buffers are reallocated as they come back from the server. */
+        if (!window->use_subsurfaces)
+        {
+            wl_list_for_each(element, &window->element_list, link)
+                element->dirty = true;
+        }
+        window->opaque_dirty = true;
+    }
+
+    trace_instant("wayland", "ack configure", "serial", serial);
+    PROBE4(configure_ack, window, serial, window->width, window->height);
+    xdg_surface_ack_configure(window->xdg_surface, serial);
+    window->configured = true;
+    window_schedule_redraw(window);
+}
+
+/*
+ * The first configure, and any that does not change the size, is
+ * applied right away.  Resizes are debounced.
+ */
+static void window_configure_notify(void* data)
+{
+    struct window* window = (struct window*)data;
+    uint64_t       now, deadline;
+    int            width, height;
+
+    pthread_mutex_lock(&window->configure_mutex);
+    width  = window->configure_width;
+    height = window->configure_height;
+    pthread_mutex_unlock(&window->configure_mutex);
+
+    if (!window->configured || width <= 0 || height <= 0 ||
+        (width == window->width && height == window->height))
+    {
+        window_apply_configure(window);
+        return;
+    }
+
+    now = frame_clock_now();
+    if (!window->resize_start_ns)
+        window->resize_start_ns = now;
+
+    deadline = std::min(now + RESIZE_DEBOUNCE_NS,
+                        window->resize_start_ns + RESIZE_MAX_DELAY_NS);
+    if (deadline <= now ||
+        event_source_timer_update(window->resize_timer, deadline) < 0)
+        window_apply_configure(window);
+}
+
+static void window_resize_timer(void* data)
+{
+    window_apply_configure((struct window*)data);
+}
+
+/* Only there to interrupt the render loop, see window_stop_rendering(). */
+static void render_wakeup(void* data)
+{
+}
+
+/* Nothing is drawn before the first configure has been applied. */
+static void* render_thread(void* data)
+{
+    struct window* window = (struct window*)data;
+
+    trace_thread_name("render");
+    if (use_perf_counters && perf_counters_open(&window->perf) < 0)
+        log_warning("no perf counters available: %s", strerror(errno));
+    while (!window->render_quit &&
+           event_loop_dispatch(window->render_loop, -1) != -1)
+        ;
+
+    return NULL;
+}
+
+/*
+ * From here on the window belongs to the render thread until
+ * window_stop_rendering().  Signals must already be routed to the main
+ * loop, the thread inherits the blocked mask.
+ */
+static int window_start_rendering(struct window* window)
+{
+    if (!window->render_wakeup || !window->configure_notify ||
+        !window->resize_timer || !window->scale_notify)
+        return -1;
+
+    window->render_quit = false;
+    if (pthread_create(&window->render_thread, NULL, render_thread, window))
+        return -1;
+
+    return 0;
+}
+
+static void window_stop_rendering(struct window* window)
 {
-    struct buffer* buffer = NULL;
-    int            ret = 0;
+    window->render_quit = true;
+    event_source_notify(window->render_wakeup);
+    pthread_join(window->render_thread, NULL);
+}
 
-    if (!window->buffers[0].busy)
-        buffer = &window->buffers[0];
-    else if (!window->buffers[1].busy)
-        buffer = &window->buffers[1];
-    else
-        return NULL;
+static void window_report_state(struct window* window, FILE* fp)
+{
+    struct element* element;
+    uint64_t        sent       = window->state.sent;
+    uint64_t        suppressed = window->state.suppressed;
 
-    if (!buffer->buffer)
+    wl_list_for_each(element, &window->element_list, link)
     {
-        ret = create_shm_buffer(window->display, buffer, window->width,
-                                window->height, WL_SHM_FORMAT_ARGB8888);
-        if (ret < 0)
-            return NULL;
-
-        /* paint the padding */
-        memset(buffer->shm_data, 0xff, window->width * window->height * 4);
+        sent += element->state.sent;
+        suppressed += element->state.suppressed;
     }
 
-    return buffer;
+    fprintf(fp,
+            "%" PRIu64 " surface state requests sent, %" PRIu64
+            " suppressed\n",
+            sent, suppressed);
 }
 
-static void paint_pixels(void* image, int width, int height, uint32_t time)
+/*
+ * Build an overlay window from the options and start drawing it.  On an
+ * output it starts at the size of the current mode, until the first
+ * configure says otherwise.
+ */
+static struct window* overlay_create(struct display*               display,
+                                     struct output*                output,
+                                     const struct overlay_options& options)
 {
-    uint32_t* pixel = (uint32_t*)image;
-    uint32_t* pSrc  = (uint32_t*)image;
+    struct window* window;
+    int            width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
 
-    for (int h = 0; h < height; h++)
+    if (output && output->width > 0 && output->height > 0)
     {
-        for (int w = 0; w < width; w++)
-        {
-            *pixel++ = 0x00000000;
-        }
+        width  = output->width / output->scale;
+        height = output->height / output->scale;
     }
-    pixel = pSrc;
 
-    // 打开PNG文件
-    // FILE *file = fopen("/home/zwh/Desktop/PrintWatermarkText.png", "rb");
-    string strLoadPng = "/home/zwh/Desktop/test.png";
-    FILE* pFile = fopen(strLoadPng.c_str(), "rb");
-    if (!pFile)
-    {
-        std::cerr << "Failed to open file " <<strLoadPng<<std::endl;
-        return;
-    }
+    window = create_window(display, output, width, height);
+    if (!window)
+        return NULL;
 
-    // 创建PNG结构体和信息结构体
-    png_structp pPngPtr =
-        png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!pPngPtr)
+    window->use_subsurfaces = options.use_subsurfaces;
+    if (options.margin_ms >= 0.0)
+        window->clock.margin_ns = options.margin_ms * 1000000.0;
+    if (options.images.empty())
+        window_add_element(window, default_image, rect_x, rect_y);
+    for (const struct image_arg& image : options.images)
+        window_add_element(window, image.path, image.x, image.y);
+    window_layout_elements(window);
+    if (options.fade_ms)
     {
-        std::cerr << "Failed to create PNG read structure" << std::endl;
-        fclose(pFile);
-        return;
+        window_set_opacity(window, 0.0);
+        window_fade_to(window, options.opacity, options.fade_ms);
     }
-
-    png_infop pPngInfo = png_create_info_struct(pPngPtr);
-    if (!pPngInfo)
+    else
     {
-        std::cerr << "Failed to create PNG info structure" << std::endl;
-        png_destroy_read_struct(&pPngPtr, NULL, NULL);
-        fclose(pFile);
-        return;
+        window_set_opacity(window, options.opacity);
     }
 
-    // 设置PNG错误处理
-    if (setjmp(png_jmpbuf(pPngPtr)))
+    /*
+     * xdg-shell wants an initial commit without a buffer, the compositor
+     * answers it with the first configure.  Attaching before that is a
+     * protocol error.
+     */
+    surface_state_flush(&window->state);
+    wl_surface_commit(window->surface);
+
+    if (window_start_rendering(window) < 0)
     {
-        std::cerr << "Failed to set PNG error handler" << std::endl;
-        png_destroy_read_struct(&pPngPtr, &pPngInfo, NULL);
-        fclose(pFile);
-        return;
+        fprintf(stderr, "failed to start the render thread\n");
+        destroy_window(window);
+        return NULL;
     }
 
-    // 初始化PNG读取
-    png_init_io(pPngPtr, pFile);
-    png_set_sig_bytes(pPngPtr, 0);
+    return window;
+}
 
-    // 读取PNG信息
-    png_read_info(pPngPtr, pPngInfo);
+static void overlay_destroy(struct window* window)
+{
+    window_stop_rendering(window);
+    destroy_window(window);
+}
 
-    // 获取PNG图像属性
-    int Pngwidth   = png_get_image_width(pPngPtr, pPngInfo);
-    int Pngheight  = png_get_image_height(pPngPtr, pPngInfo);
-    int color_type = png_get_color_type(pPngPtr, pPngInfo);
-    int bit_depth  = png_get_bit_depth(pPngPtr, pPngInfo);
+/*
+ * The overlays for an output.  The windows made when there were no
+ * outputs at startup are no longer needed once real ones are up.
+ */
+static void output_create_overlays(struct output* output)
+{
+    struct display* display = output->display;
+    struct window  *window, *tmp;
 
-    // 确定要读取的像素格式
-    png_bytep row_pointers[Pngheight];
-    int       pixel_size = 4;
-    if (color_type == PNG_COLOR_TYPE_RGB)
+    output->has_overlays = true;
+    for (const struct overlay_options& options : overlays)
     {
-        pixel_size = 3;
-    }
-    else if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
-    {
-        png_set_expand_gray_1_2_4_to_8(pPngPtr);
-        bit_depth = 8;
+        if (!overlay_create(display, output, options))
+            fprintf(stderr, "failed to create an overlay for an output\n");
     }
 
-    // 为每一行分配内存
-    for (int i = 0; i < Pngheight; i++)
+    wl_list_for_each_safe(window, tmp, &display->window_list, link)
     {
-        row_pointers[i] = new png_byte[Pngwidth * pixel_size];
+        if (!window->output)
+            overlay_destroy(window);
     }
+}
+
+static void shm_format(void* data, struct wl_shm* wl_shm, uint32_t format)
+{
+    struct display* d = (struct display*)data;
 
-    // 读取PNG像素数据
-    png_read_image(pPngPtr, row_pointers);
+    if (format == WL_SHM_FORMAT_XRGB8888)
+        d->has_xrgb = true;
+}
 
-    // 输出每个像素的RGBA值
-    for (int y = 0; y < Pngheight && y < height; y++)
-    {
-        for (int x = 0; x < Pngwidth && x < width; x++)
-        {
-            png_byte* pixelData = &(row_pointers[y][x * pixel_size]);
-            *(pixel + x)        = ((uint32_t)pixelData[3] << 24) |
-                ((uint32_t)pixelData[0] << 16) | ((uint32_t)pixelData[1] << 8) |
-                (uint32_t)pixelData[2];
-        }
-        pixel += width;
-    }
+struct wl_shm_listener shm_listener = {shm_format};
 
-    // 释放内存和关闭文件
-    for (int i = 0; i < Pngheight; i++)
-    {
-        delete[] row_pointers[i];
-    }
-    png_destroy_read_struct(&pPngPtr, &pPngInfo, NULL);
-    fclose(pFile);
+static void presentation_clock_id(void*                   data,
+                                  struct wp_presentation* presentation,
+                                  uint32_t                clk_id)
+{
+    struct display* d = (struct display*)data;
+
+    d->presentation_clock_id = clk_id;
 }
 
-// static struct wl_callback_listener frame_listener;
+static const struct wp_presentation_listener presentation_listener = {
+    presentation_clock_id};
+
+static void output_handle_geometry(void*             data,
+                                   struct wl_output* wl_output,
+                                   int32_t           x,
+                                   int32_t           y,
+                                   int32_t           physical_width,
+                                   int32_t           physical_height,
+                                   int32_t           subpixel,
+                                   const char*       make,
+                                   const char*       model,
+                                   int32_t           transform)
+{
+}
+
+static void output_handle_mode(void*             data,
+                               struct wl_output* wl_output,
+                               uint32_t          flags,
+                               int32_t           width,
+                               int32_t           height,
+                               int32_t           refresh)
+{
+    struct output* output = (struct output*)data;
+
+    if (!(flags & WL_OUTPUT_MODE_CURRENT))
+        return;
+
+    output->width  = width;
+    output->height = height;
+}
 
-static struct wl_callback_listener frame_listener = {redraw};
+static void output_create_overlays(struct output* output);
 
-static void redraw(void* data, struct wl_callback* callback, uint32_t time)
+/*
+ * A new output gets its overlays once its first batch of events is in.
+ * Later batches may change the scale the windows render at.
+ */
+static void output_handle_done(void* data, struct wl_output* wl_output)
 {
-    window* window = (struct window*)data;
-    buffer* buffer;
+    struct output*  output  = (struct output*)data;
+    struct display* display = output->display;
+    struct window*  window;
 
-    buffer = window_next_buffer(window);
-    if (!buffer)
-    {
-        fprintf(stderr,
-                !callback ? "Failed to create the first buffer.\n" :
-                            "Both buffers busy at redraw(). Server bug?\n");
-        abort();
-    }
+    output->done = true;
+    if (display->ready && !output->has_overlays)
+        output_create_overlays(output);
+
+    wl_list_for_each(window, &display->window_list, link)
+        event_source_notify(window->scale_notify);
+}
 
-    paint_pixels(buffer->shm_data, window->width, window->height, time);
+static void
+output_handle_scale(void* data, struct wl_output* wl_output, int32_t factor)
+{
+    struct output* output = (struct output*)data;
 
-    wl_surface_attach(window->surface, buffer->buffer, 0, 0);
-    wl_surface_damage(window->surface, 0, 0, window->width, window->height);
+    output->scale = factor;
+}
+
+static void
+output_handle_name(void* data, struct wl_output* wl_output, const char* name)
+{
+}
 
-    if (callback)
-        wl_callback_destroy(callback);
+static void output_handle_description(void*             data,
+                                      struct wl_output* wl_output,
+                                      const char*       description)
+{
+}
 
-    xdg_toplevel_set_parent(window->xdg_toplevel, NULL);
-    xdg_toplevel_set_maximized(window->xdg_toplevel);
+static const struct wl_output_listener output_listener = {
+    output_handle_geometry, output_handle_mode, output_handle_done,
+    output_handle_scale,    output_handle_name, output_handle_description};
 
-    window->callback = wl_surface_frame(window->surface);
+static void display_add_output(struct display* d, uint32_t id, uint32_t version)
+{
+    struct output* output;
 
-    // wl_callback_add_listener(window->callback, &frame_listener, window);
+    output = (struct output*)zalloc(sizeof *output);
+    if (!output)
+        return;
 
-    wl_surface_commit(window->surface);
-    buffer->busy = 1;
+    output->display = d;
+    output->name    = id;
+    output->scale   = 1;
+    output->output  = (struct wl_output*)wl_registry_bind(
+        d->registry, id, &wl_output_interface, std::min(version, 2u));
+    wl_output_add_listener(output->output, &output_listener, output);
+    wl_list_insert(d->output_list.prev, &output->link);
 }
 
-static void shm_format(void* data, struct wl_shm* wl_shm, uint32_t format)
+static void overlay_destroy(struct window* window);
+
+/*
+ * An unplugged output takes its overlays along.  The struct stays around
+ * for the other windows that may still have the output entered.
+ */
+static void display_remove_output(struct display* d, struct output* output)
 {
-    struct display* d = (struct display*)data;
+    struct window *window, *tmp;
 
-    if (format == WL_SHM_FORMAT_XRGB8888)
-        d->has_xrgb = true;
+    wl_list_for_each_safe(window, tmp, &d->window_list, link)
+    {
+        if (window->output == output)
+            overlay_destroy(window);
+    }
+
+    wl_output_destroy(output->output);
+    output->output  = NULL;
+    output->removed = true;
+    wl_list_remove(&output->link);
+    wl_list_insert(&d->removed_output_list, &output->link);
+
+    wl_list_for_each(window, &d->window_list, link)
+        event_source_notify(window->scale_notify);
 }
 
-struct wl_shm_listener shm_listener = {shm_format};
+static void destroy_output(struct output* output)
+{
+    if (output->output)
+        wl_output_destroy(output->output);
+    wl_list_remove(&output->link);
+    free(output);
+}
+
+/* Only what some overlay actually uses is bound. */
+static bool overlays_use_subsurfaces(void)
+{
+    for (const struct overlay_options& options : overlays)
+    {
+        if (options.use_subsurfaces)
+            return true;
+    }
+
+    return false;
+}
 
 static void registry_handle_global(void*               data,
                                    struct wl_registry* registry,
@@ -400,7 +2079,41 @@ static void registry_handle_global(void*               data,
     if (strcmp(interface, "wl_compositor") == 0)
     {
         d->compositor = (struct wl_compositor*)wl_registry_bind(
-            registry, id, &wl_compositor_interface, 1);
+            registry, id, &wl_compositor_interface, std::min(version, 4u));
+    }
+    else if (strcmp(interface, "wl_subcompositor") == 0 &&
+             overlays_use_subsurfaces())
+    {
+        d->subcompositor = (struct wl_subcompositor*)wl_registry_bind(
+            registry, id, &wl_subcompositor_interface, 1);
+    }
+    else if (strcmp(interface, wp_alpha_modifier_v1_interface.name) == 0)
+    {
+        d->alpha_modifier = (struct wp_alpha_modifier_v1*)wl_registry_bind(
+            registry, id, &wp_alpha_modifier_v1_interface, 1);
+    }
+    else if (strcmp(interface, wp_presentation_interface.name) == 0)
+    {
+        d->presentation = (struct wp_presentation*)wl_registry_bind(
+            registry, id, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(d->presentation, &presentation_listener,
+                                     d);
+    }
+    else if (strcmp(interface, wp_viewporter_interface.name) == 0)
+    {
+        d->viewporter = (struct wp_viewporter*)wl_registry_bind(
+            registry, id, &wp_viewporter_interface, 1);
+    }
+    else if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) ==
+             0)
+    {
+        d->fractional_scale_manager =
+            (struct wp_fractional_scale_manager_v1*)wl_registry_bind(
+                registry, id, &wp_fractional_scale_manager_v1_interface, 1);
+    }
+    else if (strcmp(interface, "wl_output") == 0)
+    {
+        display_add_output(d, id, version);
     }
     else if (strcmp(interface, "wl_shm") == 0)
     {
@@ -408,15 +2121,13 @@ static void registry_handle_global(void*               data,
                                                   &wl_shm_interface, 1);
         wl_shm_add_listener(d->shm, &shm_listener, d);
     }
-    else if (strcmp(interface, "wl_shell") == 0)
-    {
-        d->shell = (struct wl_shell*)wl_registry_bind(registry, id,
-                                                      &wl_shell_interface, 1);
-    }
     else if (strcmp(interface, xdg_wm_base_interface.name) == 0)
     {
         d->xdg_shell = (struct xdg_wm_base*)wl_registry_bind(
-            registry, id, &xdg_wm_base_interface, version);
+            registry, id, &xdg_wm_base_interface, std::min(version, 4u));
+
+        /* once for the connection, every window shares the proxy */
+        xdg_wm_base_add_listener(d->xdg_shell, &xdg_surface_listener, NULL);
     }
 }
 
@@ -424,6 +2135,17 @@ static void registry_handle_global_remove(void*               data,
                                           struct wl_registry* registry,
                                           uint32_t            name)
 {
+    struct display* d = (struct display*)data;
+    struct output*  output;
+
+    wl_list_for_each(output, &d->output_list, link)
+    {
+        if (output->name == name)
+        {
+            display_remove_output(d, output);
+            return;
+        }
+    }
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -433,7 +2155,7 @@ static struct display* create_display(void)
 {
     struct display* display;
 
-    display = (struct display*)malloc(sizeof *display);
+    display = (struct display*)zalloc(sizeof *display);
     if (display == NULL)
     {
         fprintf(stderr, "out of memory\n");
@@ -442,8 +2164,21 @@ static struct display* create_display(void)
     display->display = wl_display_connect(NULL);
     assert(display->display);
 
-    display->has_xrgb = false;
-    display->registry = wl_display_get_registry(display->display);
+    display->loop = event_loop_create();
+    if (!display->loop ||
+        event_loop_add_display(display->loop, display->display, NULL) < 0)
+    {
+        fprintf(stderr, "failed to create the event loop\n");
+        exit(1);
+    }
+
+    wl_list_init(&display->output_list);
+    wl_list_init(&display->removed_output_list);
+    wl_list_init(&display->window_list);
+
+    display->has_xrgb              = false;
+    display->presentation_clock_id = CLOCK_MONOTONIC;
+    display->registry              = wl_display_get_registry(display->display);
     wl_registry_add_listener(display->registry, &registry_listener, display);
     wl_display_roundtrip(display->display);
     if (display->shm == NULL)
@@ -503,13 +2238,107 @@ static struct display* create_display(void)
     return display;
 }
 
+/*
+ * Startup work that needs no compositor, done while create_display()
+ * waits on the roundtrips: decoding every image and faulting in a shm
+ * pool big enough for two buffers per overlay at the default size.
+ * Outputs larger than that grow the pool later.
+ */
+struct startup
+{
+    pthread_t             thread;
+    bool                  threaded;
+    struct shm_allocator* shm_allocator;
+    int                   error;
+};
+
+static void* startup_thread(void* data)
+{
+    struct startup* startup = (struct startup*)data;
+    size_t          size;
+
+    trace_thread_name("startup");
+    trace_begin("startup", "prepare");
+
+    size = overlays.size() * 2 * DEFAULT_WIDTH * DEFAULT_HEIGHT * 4;
+    startup->shm_allocator = shm_allocator_create(size);
+    startup->error         = errno;
+
+    /* a failure is retried, and reported, by the first frame */
+    for (const struct overlay_options& options : overlays)
+    {
+        if (options.images.empty())
+            asset_cache_get(default_image);
+        for (const struct image_arg& image : options.images)
+            asset_cache_get(image.path);
+    }
+
+    trace_end("startup", "prepare");
+
+    return NULL;
+}
+
+static void startup_begin(struct startup* startup)
+{
+    sigset_t all, saved;
+
+    memset(startup, 0, sizeof *startup);
+
+    /* the signals are not blocked on the main thread yet */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    startup->threaded =
+        pthread_create(&startup->thread, NULL, startup_thread, startup) == 0;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (!startup->threaded)
+        startup_thread(startup);
+}
+
+static void startup_finish(struct startup* startup, struct display* display)
+{
+    if (startup->threaded)
+        pthread_join(startup->thread, NULL);
+
+    display->shm_allocator = startup->shm_allocator;
+    if (!display->shm_allocator)
+    {
+        fprintf(stderr, "failed to create the shm pool: %s\n",
+                strerror(startup->error));
+        exit(1);
+    }
+    shm_allocator_bind(display->shm_allocator, display->shm);
+}
+
 static void destroy_display(struct display* display)
 {
+    struct output *output, *tmp;
+
+    wl_list_for_each_safe(output, tmp, &display->output_list, link)
+        destroy_output(output);
+    wl_list_for_each_safe(output, tmp, &display->removed_output_list, link)
+        destroy_output(output);
+
+    if (display->viewporter)
+        wp_viewporter_destroy(display->viewporter);
+
+    if (display->fractional_scale_manager)
+        wp_fractional_scale_manager_v1_destroy(
+            display->fractional_scale_manager);
+
+    if (display->shm_allocator)
+        shm_allocator_destroy(display->shm_allocator);
+
     if (display->shm)
         wl_shm_destroy(display->shm);
 
-    if (display->shell)
-        wl_shell_destroy(display->shell);
+    if (display->alpha_modifier)
+        wp_alpha_modifier_v1_destroy(display->alpha_modifier);
+
+    if (display->presentation)
+        wp_presentation_destroy(display->presentation);
+
+    if (display->subcompositor)
+        wl_subcompositor_destroy(display->subcompositor);
 
     if (display->compositor)
         wl_compositor_destroy(display->compositor);
@@ -517,46 +2346,337 @@ static void destroy_display(struct display* display)
     if (display->xdg_shell)
         xdg_wm_base_destroy(display->xdg_shell);
 
+    if (display->paint_pool)
+        thread_pool_destroy(display->paint_pool);
+
     wl_registry_destroy(display->registry);
+    event_loop_destroy(display->loop);
     wl_display_flush(display->display);
     wl_display_disconnect(display->display);
     free(display);
 }
 
-static void signal_int(int signum)
+static void handle_quit(int signum, void* data)
 {
     running = 0;
 }
 
+/* Nanoseconds from main() to the first commit, 0 before there is one. */
+static uint64_t time_to_first_commit(void)
+{
+    uint64_t first = first_commit_ns.load(std::memory_order_relaxed);
+
+    return first ? first - start_ns : 0;
+}
+
+/*
+ * Write the time to the first commit and the phase histograms of every
+ * window as JSON, to --timings or to stderr without it.
+ */
+static void write_timings(struct display* display)
+{
+    struct window* window;
+    FILE*          fp    = stderr;
+    bool           first = true;
+
+    if (timings_path)
+    {
+        fp = fopen(timings_path, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "cannot write %s: %s\n", timings_path,
+                    strerror(errno));
+            return;
+        }
+    }
+
+    fprintf(fp, "{\"time_to_first_commit_ns\": %" PRIu64 ",\n \"windows\": [",
+            time_to_first_commit());
+    wl_list_for_each(window, &display->window_list, link)
+    {
+        fprintf(fp, "%s\n  ", first ? "" : ",");
+        frame_timings_write_json(&window->timings, fp);
+        first = false;
+    }
+    fprintf(fp, "\n]}\n");
+
+    if (fp != stderr)
+        fclose(fp);
+}
+
+static void handle_dump_timings(int signum, void* data)
+{
+    write_timings((struct display*)data);
+}
+
+/*
+ * A snapshot of the counters, taken on the main thread while the render
+ * threads carry on.  Every number is read without stopping them, so the
+ * lines are each consistent but not necessarily with one another.
+ */
+static void write_stats(struct display* display, FILE* fp)
+{
+    struct asset_cache_stats assets;
+    struct window*           window;
+    struct element*          element;
+    int                      n = 0, buffers;
+    uint64_t                 lookups;
+
+    fprintf(fp, "stats:\n");
+    fprintf(fp, "time to first commit: %.3f ms\n",
+            time_to_first_commit() / 1e6);
+    wl_list_for_each(window, &display->window_list, link)
+    {
+        buffers = 2;
+        if (window->use_subsurfaces)
+        {
+            buffers = 0;
+            wl_list_for_each(element, &window->element_list, link)
+                buffers += 2;
+        }
+
+        fprintf(fp,
+                "window %d: %" PRIu64 " commits, %" PRIu64
+                " frames painted, %" PRIu64 " refresh cycles skipped, %" PRIu64
+                " deadlines missed, %" PRIu64
+                " buffer stalls, %d of %d buffers held by the compositor\n",
+                n++, window->stats.commits.load(),
+                window->stats.painted.load(), window->stats.skipped.load(),
+                window->stats.missed.load(), window->stats.stalls.load(),
+                window->stats.busy.load(), buffers);
+        perf_counters_write(&window->perf, fp);
+    }
+
+    fprintf(fp, "shm: %zu B mapped, %zu B in use\n",
+            shm_allocator_mapped(display->shm_allocator),
+            shm_allocator_used(display->shm_allocator));
+
+    asset_cache_get_stats(&assets);
+    lookups = assets.hits + assets.misses;
+    fprintf(fp,
+            "assets: %d cached, %zu B, %.1f%% cache hits "
+            "(%" PRIu64 " of %" PRIu64 " lookups)\n",
+            assets.count, assets.bytes,
+            lookups ? 100.0 * assets.hits / lookups : 0.0, assets.hits,
+            lookups);
+
+    request_stats_write(fp);
+}
+
+static void handle_dump_stats(int signum, void* data)
+{
+    struct display* display = (struct display*)data;
+    FILE*           fp      = stderr;
+
+    if (stats_path)
+    {
+        fp = fopen(stats_path, "a");
+        if (!fp)
+        {
+            fprintf(stderr, "cannot write %s: %s\n", stats_path,
+                    strerror(errno));
+            return;
+        }
+    }
+
+    write_stats(display, fp);
+
+    if (fp != stderr)
+        fclose(fp);
+    else
+        fflush(fp);
+}
+
+static void usage(int error_code)
+{
+    fprintf(stderr,
+            "Usage: WaylandWnd [OPTIONS]\n\n"
+            "  -i, --image PATH[@X,Y]\tAdd a watermark image at (X, Y),\n"
+            "\t\t\tnegative values are taken from the right/bottom\n"
+            "  -s, --subsurfaces\tGive every image its own subsurface\n"
+            "  -o, --opacity VALUE\tWatermark opacity from 0 to 1\n"
+            "  -f, --fade MS\t\tFade the watermark in over MS milliseconds\n"
+            "  -m, --margin MS\tFinish painting MS milliseconds before vblank\n"
+            "  -t, --threads N\tPaint with N threads, default one per CPU\n"
+            "  -T, --timings PATH\tWrite per-phase frame timings as JSON\n"
+            "\t\t\tto PATH on SIGUSR2 and at exit\n"
+            "  -S, --stats PATH\tAppend the counters to PATH on SIGUSR1,\n"
+            "\t\t\tinstead of writing them to stderr\n"
+            "  --perf-counters\tCount cycles, instructions, cache and TLB\n"
+            "\t\t\tmisses per paint phase, shown in the stats\n"
+            "  --trace PATH\t\tRecord a timeline and write it to PATH at\n"
+            "\t\t\texit, for ui.perfetto.dev or chrome://tracing\n"
+            "  -w, --window\t\tStart another overlay, the options that\n"
+            "\t\t\tfollow apply to it\n"
+            "  -h, --help\t\tThis help text\n\n");
+
+    exit(error_code);
+}
+
+static bool parse_image_arg(char* arg, int* x, int* y)
+{
+    char* at = strrchr(arg, '@');
+
+    *x = rect_x;
+    *y = rect_y;
+    if (!at)
+        return true;
+
+    *at = '\0';
+    return sscanf(at + 1, "%d,%d", x, y) == 2;
+}
+
 int main(int argc, char** argv)
 {
-    struct sigaction sigint;
     struct display*  display;
-    struct window*   window;
-    int              ret = 0;
+    struct window   *window, *tmp;
+    struct output*   output;
+    struct image_arg image;
+    struct startup   startup;
+    int              threads = thread_pool_cpu_count();
+    int              ret     = 0;
+    int              i;
+
+    start_ns = frame_clock_now();
+    overlays.resize(1);
+    for (i = 1; i < argc; i++)
+    {
+        struct overlay_options& options = overlays.back();
+
+        if (strcmp("-w", argv[i]) == 0 || strcmp("--window", argv[i]) == 0)
+            overlays.resize(overlays.size() + 1);
+        else if (strcmp("-s", argv[i]) == 0 ||
+                 strcmp("--subsurfaces", argv[i]) == 0)
+            options.use_subsurfaces = true;
+        else if ((strcmp("-o", argv[i]) == 0 ||
+                  strcmp("--opacity", argv[i]) == 0) &&
+                 i + 1 < argc)
+            options.opacity = atof(argv[++i]);
+        else if ((strcmp("-f", argv[i]) == 0 ||
+                  strcmp("--fade", argv[i]) == 0) &&
+                 i + 1 < argc)
+            options.fade_ms = strtoul(argv[++i], NULL, 10);
+        else if ((strcmp("-m", argv[i]) == 0 ||
+                  strcmp("--margin", argv[i]) == 0) &&
+                 i + 1 < argc)
+            options.margin_ms = atof(argv[++i]);
+        else if ((strcmp("-t", argv[i]) == 0 ||
+                  strcmp("--threads", argv[i]) == 0) &&
+                 i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if ((strcmp("-T", argv[i]) == 0 ||
+                  strcmp("--timings", argv[i]) == 0) &&
+                 i + 1 < argc)
+            timings_path = argv[++i];
+        else if ((strcmp("-S", argv[i]) == 0 ||
+                  strcmp("--stats", argv[i]) == 0) &&
+                 i + 1 < argc)
+            stats_path = argv[++i];
+        else if (strcmp("--perf-counters", argv[i]) == 0)
+            use_perf_counters = true;
+        else if (strcmp("--trace", argv[i]) == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if ((strcmp("-i", argv[i]) == 0 ||
+                  strcmp("--image", argv[i]) == 0) &&
+                 i + 1 < argc)
+        {
+            image.path = argv[++i];
+            if (!parse_image_arg(image.path, &image.x, &image.y))
+                usage(EXIT_FAILURE);
+            options.images.push_back(image);
+        }
+        else if (strcmp("-h", argv[i]) == 0 ||
+                 strcmp("--help", argv[i]) == 0)
+            usage(EXIT_SUCCESS);
+        else
+            usage(EXIT_FAILURE);
+    }
+
+    if (trace_path)
+    {
+        trace_enable();
+        trace_thread_name("main");
+    }
 
+    /* Failing that, messages are written as they come. */
+    log_start();
+
+    startup_begin(&startup);
     display = create_display();
-    window  = create_window(display, 1920, 1080);
-    if (!window)
-        return 1;
+    startup_finish(&startup, display);
+    for (struct overlay_options& options : overlays)
+    {
+        if (options.use_subsurfaces && !display->subcompositor)
+        {
+            fprintf(stderr, "wl_subcompositor not available, "
+                            "falling back to a single surface\n");
+            options.use_subsurfaces = false;
+        }
+    }
 
-    sigint.sa_handler = signal_int;
-    sigemptyset(&sigint.sa_mask);
-    sigint.sa_flags = SA_RESETHAND;
-    sigaction(SIGINT, &sigint, NULL);
+    display->paint_pool = thread_pool_create(threads);
 
-    /* Initialise damage to full surface, so the padding gets painted */
-    wl_surface_damage(window->surface, 0, 0, window->width, window->height);
+    /* Before any render thread exists, they inherit the blocked mask. */
+    event_loop_add_signal(display->loop, SIGINT, handle_quit, NULL);
+    event_loop_add_signal(display->loop, SIGTERM, handle_quit, NULL);
+    event_loop_add_signal(display->loop, SIGUSR1, handle_dump_stats,
+                          display);
+    event_loop_add_signal(display->loop, SIGUSR2, handle_dump_timings,
+                          display);
 
-    redraw(window, NULL, 0);
+    /*
+     * Every overlay on every output, all sharing the connection, the shm
+     * pool and the decoded images.
+     */
+    display->ready = true;
+    wl_list_for_each(output, &display->output_list, link)
+    {
+        if (output->done)
+            output_create_overlays(output);
+    }
+    if (wl_list_empty(&display->window_list))
+    {
+        for (const struct overlay_options& options : overlays)
+        {
+            if (!overlay_create(display, NULL, options))
+                return 1;
+        }
+    }
 
     while (running && ret != -1)
-        ret = wl_display_dispatch(display->display);
+        ret = event_loop_dispatch(display->loop, -1);
 
     fprintf(stderr, "simple-shm exiting\n");
+    wl_list_for_each(window, &display->window_list, link)
+        window_stop_rendering(window);
+    if (timings_path)
+        write_timings(display);
+
+    wl_list_for_each_safe(window, tmp, &display->window_list, link)
+    {
+        fprintf(stderr, "window %dx%d:\n", window->width, window->height);
+        frame_clock_report(&window->clock, stderr);
+        window_report_state(window, stderr);
+        perf_counters_write(&window->perf, stderr);
+        destroy_window(window);
+    }
+    fprintf(stderr, "%zu B of shared memory mapped\n",
+            shm_allocator_mapped(display->shm_allocator));
+    fprintf(stderr, "time to first commit: %.3f ms\n",
+            time_to_first_commit() / 1e6);
 
-    destroy_window(window);
     destroy_display(display);
+    asset_cache_clear();
+    log_stop();
+
+    /* Every other thread that recorded has been joined by now. */
+    if (trace_path)
+    {
+        if (trace_write(trace_path) < 0)
+            fprintf(stderr, "cannot write %s: %s\n", trace_path,
+                    strerror(errno));
+        trace_shutdown();
+    }
 
     return 0;
 }
@@ -37,6 +37,7 @@
 #include <sys/mman.h>
 
 #include "os-compatibility.h"
+#include "probes.h"
 
 #define READONLY_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
 
@@ -166,7 +167,6 @@ os_create_anonymous_file(off_t size)
 	const char *path;
 	char *name;
 	int fd;
-	int ret;
 
 #ifdef HAVE_MEMFD_CREATE
 	fd = memfd_create("weston-shared", MFD_CLOEXEC | MFD_ALLOW_SEALING);
@@ -202,12 +202,30 @@ os_create_anonymous_file(off_t size)
 			return -1;
 	}
 
+	if (os_resize_anonymous_file(fd, size) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	PROBE2(anon_file_create, fd, size);
+
+	return fd;
+}
+
+/*
+ * Grow a file made by os_create_anonymous_file().  Shrinking is not
+ * possible, memfds are sealed against it.
+ */
+int
+os_resize_anonymous_file(int fd, off_t size)
+{
+	int ret;
+
 #ifdef HAVE_POSIX_FALLOCATE
 	do {
 		ret = posix_fallocate(fd, 0, size);
 	} while (ret == EINTR);
 	if (ret != 0) {
-		close(fd);
 		errno = ret;
 		return -1;
 	}
@@ -215,13 +233,11 @@ os_create_anonymous_file(off_t size)
 	do {
 		ret = ftruncate(fd, size);
 	} while (ret < 0 && errno == EINTR);
-	if (ret < 0) {
-		close(fd);
+	if (ret < 0)
 		return -1;
-	}
 #endif
 
-	return fd;
+	return 0;
 }
 
 #ifndef HAVE_STRCHRNUL
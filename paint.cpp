@@ -0,0 +1,184 @@
+#include "config.h"
+
+#include <stdint.h>
+
+#include "asset.h"
+#include "clock.h"
+#include "paint.h"
+#include "pixel-kernels.h"
+#include "thread-pool.h"
+#include "trace.h"
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * A few bands per thread, so that work stealing can even out bands that
+ * hold images against bands that are only cleared.
+ */
+#define BANDS_PER_THREAD 4
+
+struct paint_job
+{
+    uint32_t*                 pixels;
+    int                       width, height;
+    int                       band_rows;
+    const struct paint_layer* layers;
+    int                       n_layers;
+    uint32_t                  alpha;
+    bool                      stream;
+    struct paint_timings*     timings;
+};
+
+static int gcd(int a, int b)
+{
+    while (b)
+    {
+        int t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/*
+ * Bands start on a cache line.  Page boundaries would do too, but for
+ * widths like 1366 or 1707 they are hundreds of rows apart and leave
+ * fewer bands than threads.
+ */
+int paint_band_rows(int width, int height, int n_threads)
+{
+    int stride = width * 4;
+    int align  = CACHE_LINE_SIZE / gcd(stride, CACHE_LINE_SIZE);
+    int rows;
+
+    if (n_threads <= 1)
+        return height;
+
+    rows = (height + n_threads * BANDS_PER_THREAD - 1) /
+        (n_threads * BANDS_PER_THREAD);
+    rows = (rows + align - 1) / align * align;
+
+    return rows < height ? rows : height;
+}
+
+/* Copy the rows of a layer that fall within [y0, y1). */
+static void blit_layer(const struct paint_job*   job,
+                       const struct paint_layer* layer,
+                       int                       y0,
+                       int                       y1)
+{
+    const struct asset* asset = layer->asset;
+    int                 x0, x1;
+
+    x0 = layer->x < 0 ? 0 : layer->x;
+    x1 = layer->x + asset->width < job->width ? layer->x + asset->width :
+                                                job->width;
+    if (x1 <= x0)
+        return;
+
+    if (layer->y > y0)
+        y0 = layer->y;
+    if (layer->y + asset->height < y1)
+        y1 = layer->y + asset->height;
+
+    for (int h = y0; h < y1; h++)
+    {
+        pixel_scale_alpha(job->pixels + h * job->width + x0,
+                          asset->pixels + (h - layer->y) * asset->width +
+                              (x0 - layer->x),
+                          x1 - x0, job->alpha);
+    }
+}
+
+static bool band_has_layers(const struct paint_job* job, int y0, int y1)
+{
+    for (int i = 0; i < job->n_layers; i++)
+    {
+        const struct paint_layer* layer = &job->layers[i];
+
+        if (layer->y < y1 && layer->y + layer->asset->height > y0)
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * Bands no image touches are not read again before the compositor
+ * samples them, so on surfaces too big for the cache they are cleared
+ * with streaming stores.  Bands about to be blitted into are cleared
+ * through the cache, which the blit then hits.
+ */
+static void paint_band(int band, void* data)
+{
+    const struct paint_job* job = (const struct paint_job*)data;
+    int                     y0  = band * job->band_rows;
+    int                     y1  = y0 + job->band_rows;
+    uint32_t*               pixel;
+    size_t                  count;
+    uint64_t                start = 0, cleared = 0;
+
+    if (y1 > job->height)
+        y1 = job->height;
+
+    if (job->timings)
+        start = clock_now_ns();
+
+    trace_begin("paint", "clear");
+    pixel = job->pixels + (size_t)y0 * job->width;
+    count = (size_t)(y1 - y0) * job->width;
+    if (job->stream && !band_has_layers(job, y0, y1))
+        pixel_fill_stream(pixel, 0x00000000, count);
+    else
+        pixel_fill(pixel, 0x00000000, count);
+    trace_end("paint", "clear");
+
+    if (job->timings)
+        cleared = clock_now_ns();
+
+    trace_begin("paint", "blit");
+    for (int i = 0; i < job->n_layers; i++)
+        blit_layer(job, &job->layers[i], y0, y1);
+    trace_end("paint", "blit");
+
+    if (job->timings)
+    {
+        job->timings->clear_ns += cleared - start;
+        job->timings->blit_ns += clock_now_ns() - cleared;
+    }
+}
+
+void paint_surface(struct thread_pool*       pool,
+                   uint32_t*                 pixels,
+                   int                       width,
+                   int                       height,
+                   const struct paint_layer* layers,
+                   int                       n_layers,
+                   uint32_t                  alpha,
+                   struct paint_timings*     timings)
+{
+    struct paint_job job;
+    int              n_threads = pool ? thread_pool_size(pool) : 1;
+    int              n_bands;
+
+    job.pixels    = pixels;
+    job.width     = width;
+    job.height    = height;
+    job.band_rows = paint_band_rows(width, height, n_threads);
+    job.layers    = layers;
+    job.n_layers  = n_layers;
+    job.alpha     = alpha;
+    job.stream    = (size_t)width * height * 4 > pixel_cache_size();
+    job.timings   = timings;
+
+    if (height <= 0)
+        return;
+
+    n_bands = (height + job.band_rows - 1) / job.band_rows;
+    if (pool)
+        thread_pool_run(pool, n_bands, paint_band, &job);
+    else
+        paint_band(0, &job);
+}
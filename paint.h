@@ -0,0 +1,50 @@
+#ifndef PAINT_H
+#define PAINT_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+struct asset;
+struct thread_pool;
+
+/* An image to composite, with its top left corner at (x, y). */
+struct paint_layer
+{
+    const struct asset* asset;
+    int                 x, y;
+};
+
+/*
+ * CPU time paint_surface() spent clearing and copying images in, summed
+ * over all bands in CLOCK_MONOTONIC nanoseconds.
+ */
+struct paint_timings
+{
+    std::atomic<uint64_t> clear_ns;
+    std::atomic<uint64_t> blit_ns;
+};
+
+/*
+ * Clear a width x height ARGB8888 surface to transparent and copy the
+ * layers on top, in order, with their alpha scaled by alpha.
+ *
+ * The surface is cut into horizontal bands that the pool paints in
+ * parallel.  Band boundaries fall on cache line boundaries of a buffer
+ * aligned to one, so no two threads ever write to the same cache line.
+ *
+ * When timings is not NULL the time of each band is added to it.
+ */
+void paint_surface(struct thread_pool*       pool,
+                   uint32_t*                 pixels,
+                   int                       width,
+                   int                       height,
+                   const struct paint_layer* layers,
+                   int                       n_layers,
+                   uint32_t                  alpha,
+                   struct paint_timings*     timings);
+
+/* Rows per band paint_surface() uses for n_threads threads. */
+int paint_band_rows(int width, int height, int n_threads);
+
+#endif /* PAINT_H */
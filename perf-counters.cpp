@@ -0,0 +1,215 @@
+#include "config.h"
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf-counters.h"
+
+struct counter_desc
+{
+    const char* name;
+    uint32_t    type;
+    uint64_t    config;
+};
+
+#define CACHE_READ_MISS(cache)                                                \
+    ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 |                             \
+     PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+static const struct counter_desc hardware_counters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"LLC-misses", PERF_TYPE_HW_CACHE,
+     CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"dTLB-misses", PERF_TYPE_HW_CACHE,
+     CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+static const struct counter_desc software_counters[] = {
+    {"task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static const char* const phase_names[PERF_PHASE_COUNT] = {
+    "acquire", "decode", "paint", "submit"};
+
+void perf_counters_init(struct perf_counters* pc)
+{
+    memset(pc, 0, sizeof *pc);
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        pc->fds[i] = -1;
+    pthread_mutex_init(&pc->mutex, NULL);
+}
+
+void perf_counters_release(struct perf_counters* pc)
+{
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+    {
+        if (pc->fds[i] >= 0)
+            close(pc->fds[i]);
+    }
+    pthread_mutex_destroy(&pc->mutex);
+}
+
+static int open_counter(const struct counter_desc* desc, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.size           = sizeof attr;
+    attr.type           = desc->type;
+    attr.config         = desc->config;
+    attr.read_format    = PERF_FORMAT_GROUP;
+    attr.disabled       = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Open as much of the group as the machine has; a member that fails is
+ * left out, a leader that fails fails the group.
+ */
+static int open_group(struct perf_counters*      pc,
+                      const struct counter_desc* descs,
+                      int                        n_descs)
+{
+    int n = 0, fd;
+
+    for (int i = 0; i < n_descs; i++)
+    {
+        fd = open_counter(&descs[i], n ? pc->fds[0] : -1);
+        if (fd < 0)
+        {
+            if (!n)
+                return -1;
+            continue;
+        }
+
+        pc->fds[n]   = fd;
+        pc->names[n] = descs[i].name;
+        n++;
+    }
+
+    return n;
+}
+
+/* One read of the whole group: the count, then one value per member. */
+static int read_group(struct perf_counters* pc, uint64_t* values)
+{
+    uint64_t buf[1 + PERF_MAX_COUNTERS];
+    ssize_t  size = (1 + pc->n_counters) * sizeof buf[0];
+
+    if (read(pc->fds[0], buf, size) != size)
+        return -1;
+
+    memcpy(values, buf + 1, pc->n_counters * sizeof *values);
+
+    return 0;
+}
+
+int perf_counters_open(struct perf_counters* pc)
+{
+    int  n;
+    bool software = false;
+
+    n = open_group(pc, hardware_counters,
+                   sizeof hardware_counters / sizeof hardware_counters[0]);
+    if (n < 0)
+    {
+        software = true;
+        n        = open_group(pc, software_counters,
+                              sizeof software_counters /
+                                  sizeof software_counters[0]);
+    }
+    if (n < 0)
+        return -1;
+
+    ioctl(pc->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    pthread_mutex_lock(&pc->mutex);
+    pc->software   = software;
+    pc->n_counters = n;
+    pthread_mutex_unlock(&pc->mutex);
+
+    return 0;
+}
+
+void perf_counters_start(struct perf_counters* pc)
+{
+    if (pc->n_counters)
+        read_group(pc, pc->last);
+}
+
+void perf_counters_mark(struct perf_counters* pc, enum perf_phase phase)
+{
+    uint64_t now[PERF_MAX_COUNTERS];
+
+    if (!pc->n_counters || read_group(pc, now) < 0)
+        return;
+
+    for (int i = 0; i < pc->n_counters; i++)
+    {
+        pc->frame[phase][i] += now[i] - pc->last[i];
+        pc->last[i] = now[i];
+    }
+    pc->phases |= 1u << phase;
+}
+
+void perf_counters_commit(struct perf_counters* pc)
+{
+    if (!pc->phases)
+        return;
+
+    pthread_mutex_lock(&pc->mutex);
+    for (int p = 0; p < PERF_PHASE_COUNT; p++)
+    {
+        if (!(pc->phases & 1u << p))
+            continue;
+
+        for (int i = 0; i < pc->n_counters; i++)
+            pc->totals[p][i] += pc->frame[p][i];
+        pc->samples[p]++;
+    }
+    pthread_mutex_unlock(&pc->mutex);
+
+    memset(pc->frame, 0, sizeof pc->frame);
+    pc->phases = 0;
+}
+
+void perf_counters_write(struct perf_counters* pc, FILE* fp)
+{
+    pthread_mutex_lock(&pc->mutex);
+
+    if (pc->n_counters)
+        fprintf(fp, "perf counters (%s), per frame:\n",
+                pc->software ? "software" : "hardware");
+
+    for (int p = 0; p < PERF_PHASE_COUNT && pc->n_counters; p++)
+    {
+        if (!pc->samples[p])
+            continue;
+
+        fprintf(fp, "  %s:", phase_names[p]);
+        for (int i = 0; i < pc->n_counters; i++)
+            fprintf(fp, "%s %.0f %s", i ? "," : "",
+                    (double)pc->totals[p][i] / pc->samples[p], pc->names[i]);
+
+        /* cycles always leads the hardware group */
+        if (!pc->software && pc->n_counters > 1 &&
+            pc->names[1] == hardware_counters[1].name && pc->totals[p][0])
+            fprintf(fp, " (IPC %.2f)",
+                    (double)pc->totals[p][1] / pc->totals[p][0]);
+        fprintf(fp, "\n");
+    }
+
+    pthread_mutex_unlock(&pc->mutex);
+}
@@ -0,0 +1,71 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PERF_MAX_COUNTERS 4
+
+/*
+ * What a frame's counter deltas are charged to.  Paint covers only the
+ * bands the render thread paints itself, the pool workers are not
+ * counted.
+ */
+enum perf_phase
+{
+    PERF_PHASE_ACQUIRE,
+    PERF_PHASE_DECODE,
+    PERF_PHASE_PAINT,
+    PERF_PHASE_SUBMIT,
+    PERF_PHASE_COUNT
+};
+
+/*
+ * Self-profiling with perf_event_open(2) counters on one thread.
+ *
+ * The hardware group is cycles, instructions, LLC and dTLB read misses.
+ * Where there is no PMU, as in most VMs, or perf_event_paranoid forbids
+ * it, the group falls back to the task-clock and page-fault software
+ * counters.  User space only; one read() per phase mark.
+ *
+ * The owning thread opens, marks and commits; the totals can be written
+ * from any thread.
+ */
+struct perf_counters
+{
+    int         fds[PERF_MAX_COUNTERS];
+    const char* names[PERF_MAX_COUNTERS];
+    bool        software;
+
+    /* Owner only: the last reading and the frame being measured. */
+    uint64_t last[PERF_MAX_COUNTERS];
+    uint64_t frame[PERF_PHASE_COUNT][PERF_MAX_COUNTERS];
+    uint32_t phases;
+
+    pthread_mutex_t mutex;
+    int             n_counters;
+    uint64_t        totals[PERF_PHASE_COUNT][PERF_MAX_COUNTERS];
+    uint64_t        samples[PERF_PHASE_COUNT];
+};
+
+void perf_counters_init(struct perf_counters* pc);
+
+void perf_counters_release(struct perf_counters* pc);
+
+/* Open the counters for the calling thread.  -1 when none could be. */
+int perf_counters_open(struct perf_counters* pc);
+
+/* Take the reading the first mark of a frame is measured from. */
+void perf_counters_start(struct perf_counters* pc);
+
+/* Charge everything counted since the last reading to phase. */
+void perf_counters_mark(struct perf_counters* pc, enum perf_phase phase);
+
+/* Add the frame to the totals. */
+void perf_counters_commit(struct perf_counters* pc);
+
+/* Per-phase averages per frame, nothing if the counters are not open. */
+void perf_counters_write(struct perf_counters* pc, FILE* fp);
+
+#endif /* PERF_COUNTERS_H */
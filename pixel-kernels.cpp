@@ -0,0 +1,177 @@
+#include "config.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#    include <emmintrin.h>
+#endif
+
+#include "pixel-kernels.h"
+
+/* x * a / 255 rounded, for x and a in [0, 255]. */
+static inline uint32_t mul_un8(uint32_t x, uint32_t a)
+{
+    uint32_t t = x * a + 0x80;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t scale_pixel(uint32_t p, uint32_t alpha)
+{
+    return (mul_un8(p >> 24, alpha) << 24) |
+        (mul_un8((p >> 16) & 0xff, alpha) << 16) |
+        (mul_un8((p >> 8) & 0xff, alpha) << 8) | mul_un8(p & 0xff, alpha);
+}
+
+void pixel_scale_alpha(uint32_t*       dst,
+                       const uint32_t* src,
+                       int             count,
+                       uint32_t        alpha)
+{
+    int i = 0;
+
+    if (alpha >= 255)
+    {
+        if (dst != src)
+            memmove(dst, src, count * 4);
+        return;
+    }
+
+#ifdef __SSE2__
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i a16   = _mm_set1_epi16((short)alpha);
+    const __m128i round = _mm_set1_epi16(0x80);
+    const __m128i d255  = _mm_set1_epi16(0x0101);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s  = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(s, zero);
+        __m128i hi = _mm_unpackhi_epi8(s, zero);
+
+        /* (x * a + 0x80) * 257 >> 16 is the exact rounded x * a / 255 */
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, a16), round);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, a16), round);
+        lo = _mm_mulhi_epu16(lo, d255);
+        hi = _mm_mulhi_epu16(hi, d255);
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++)
+        dst[i] = scale_pixel(src[i], alpha);
+}
+
+void pixel_premultiply(uint32_t* dst, const uint8_t* src, int count)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i round  = _mm_set1_epi16(0x80);
+    const __m128i d255   = _mm_set1_epi16(0x0101);
+    const __m128i opaque = _mm_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s  = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        __m128i lo = _mm_unpacklo_epi8(s, zero);
+        __m128i hi = _mm_unpackhi_epi8(s, zero);
+        __m128i alo, ahi;
+
+        /* every channel times its pixel's alpha, alpha itself times 255 */
+        alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+        ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+        lo  = _mm_add_epi16(_mm_mullo_epi16(lo, _mm_or_si128(alo, opaque)),
+                            round);
+        hi  = _mm_add_epi16(_mm_mullo_epi16(hi, _mm_or_si128(ahi, opaque)),
+                            round);
+        lo  = _mm_mulhi_epu16(lo, d255);
+        hi  = _mm_mulhi_epu16(hi, d255);
+
+        /* R G B A to B G R A, which is ARGB read as a little-endian word */
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xc6), 0xc6);
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xc6), 0xc6);
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        const uint8_t* p = src + i * 4;
+        uint32_t       a = p[3];
+
+        dst[i] = (a << 24) | (mul_un8(p[0], a) << 16) |
+            (mul_un8(p[1], a) << 8) | mul_un8(p[2], a);
+    }
+}
+
+void pixel_fill(uint32_t* dst, uint32_t value, size_t count)
+{
+#ifdef __SSE2__
+    const __m128i v = _mm_set1_epi32(value);
+
+    for (; count && ((uintptr_t)dst & 15); count--)
+        *dst++ = value;
+
+    for (; count >= 16; count -= 16, dst += 16)
+    {
+        _mm_store_si128((__m128i*)dst, v);
+        _mm_store_si128((__m128i*)dst + 1, v);
+        _mm_store_si128((__m128i*)dst + 2, v);
+        _mm_store_si128((__m128i*)dst + 3, v);
+    }
+#endif
+
+    while (count--)
+        *dst++ = value;
+}
+
+void pixel_fill_stream(uint32_t* dst, uint32_t value, size_t count)
+{
+#ifdef __SSE2__
+    const __m128i v = _mm_set1_epi32(value);
+
+    for (; count && ((uintptr_t)dst & 15); count--)
+        *dst++ = value;
+
+    /* a whole cache line per iteration, so lines are combined fully */
+    for (; count >= 16; count -= 16, dst += 16)
+    {
+        _mm_stream_si128((__m128i*)dst, v);
+        _mm_stream_si128((__m128i*)dst + 1, v);
+        _mm_stream_si128((__m128i*)dst + 2, v);
+        _mm_stream_si128((__m128i*)dst + 3, v);
+    }
+
+    /* order the streaming stores before anything published after us */
+    _mm_sfence();
+#endif
+
+    while (count--)
+        *dst++ = value;
+}
+
+size_t pixel_cache_size(void)
+{
+    static const size_t size = [] {
+        long llc = -1;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        if (llc <= 0)
+            llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+
+        return llc > 0 ? (size_t)llc : (size_t)8 << 20;
+    }();
+
+    return size;
+}
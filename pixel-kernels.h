@@ -0,0 +1,34 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pixel loops shared by the paint paths.  All of them work on
+ * premultiplied ARGB8888 and have an SSE2 path with a scalar tail.
+ */
+
+/* dst[i] = src[i] * alpha / 255 on all four channels, dst may equal src. */
+void pixel_scale_alpha(uint32_t*       dst,
+                       const uint32_t* src,
+                       int             count,
+                       uint32_t        alpha);
+
+/* Straight RGBA8 bytes, as libpng decodes them, to premultiplied ARGB. */
+void pixel_premultiply(uint32_t* dst, const uint8_t* src, int count);
+
+/* dst[i] = value, through the cache; for buffers that are read back soon. */
+void pixel_fill(uint32_t* dst, uint32_t value, size_t count);
+
+/*
+ * dst[i] = value with non-temporal stores that bypass the cache.  Only
+ * worth it when the buffer is larger than the last level cache, or will
+ * not be touched again before the compositor reads it.
+ */
+void pixel_fill_stream(uint32_t* dst, uint32_t value, size_t count);
+
+/* Size of the last level cache in bytes, 8 MiB if it cannot be found. */
+size_t pixel_cache_size(void);
+
+#endif /* PIXEL_KERNELS_H */
@@ -0,0 +1,39 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes for bpftrace and perf, all under the provider "waylandwnd".
+ *
+ * With <sys/sdt.h> (systemtap-sdt-dev) a probe is a single nop plus an
+ * ELF note, free until a tracer attaches to the running process:
+ *
+ *     bpftrace -l 'usdt:./WaylandWnd:waylandwnd:*'
+ *     perf buildid-cache --add ./WaylandWnd && perf list sdt
+ *
+ * Without the header, or with NO_PROBES defined, they compile to nothing
+ * and their arguments are not evaluated.
+ */
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef HAVE_PROBES
+#define PROBE0(name) DTRACE_PROBE(waylandwnd, name)
+#define PROBE1(name, a) DTRACE_PROBE1(waylandwnd, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(waylandwnd, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(waylandwnd, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(waylandwnd, name, a, b, c, d)
+#else
+#define PROBE0(name) ((void)0)
+#define PROBE1(name, a) ((void)sizeof(a))
+#define PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c)                                                 \
+    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d)                                              \
+    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#endif
+
+#endif /* PROBES_H */
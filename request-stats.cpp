@@ -0,0 +1,61 @@
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#include "request-stats.h"
+
+/* More interfaces than the client ever binds; the rest go uncounted. */
+#define MAX_INTERFACES 32
+
+/*
+ * wl_proxy_get_class() returns the name stored in the interface, so one
+ * interface always yields the same pointer and slots compare by it.
+ */
+struct request_count
+{
+    std::atomic<const char*> name;
+    std::atomic<uint64_t>    count;
+};
+
+static struct request_count counts[MAX_INTERFACES];
+
+void request_stats_count(struct wl_proxy* proxy)
+{
+    const char* name = wl_proxy_get_class(proxy);
+    const char* slot;
+
+    for (int i = 0; i < MAX_INTERFACES; i++)
+    {
+        slot = counts[i].name.load(std::memory_order_acquire);
+        if (!slot &&
+            (counts[i].name.compare_exchange_strong(slot, name) ||
+             slot == name))
+            slot = name;
+        if (slot == name)
+        {
+            counts[i].count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void request_stats_write(FILE* fp)
+{
+    const char* name;
+
+    fprintf(fp, "requests:");
+    for (int i = 0; i < MAX_INTERFACES; i++)
+    {
+        name = counts[i].name.load(std::memory_order_acquire);
+        if (!name)
+            break;
+
+        fprintf(fp, "%s %s %" PRIu64, i ? "," : "", name,
+                counts[i].count.load(std::memory_order_relaxed));
+    }
+    fprintf(fp, "\n");
+}
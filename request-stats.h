@@ -0,0 +1,25 @@
+#ifndef REQUEST_STATS_H
+#define REQUEST_STATS_H
+
+#include <stdio.h>
+
+#include <wayland-client-core.h>
+
+/*
+ * Per-interface counts of the requests this process sends.
+ *
+ * The generated protocol stubs send every request through
+ * wl_proxy_marshal_flags().  A translation unit that includes this
+ * header before any protocol header has those calls counted on the way
+ * through; the parentheses around the real name keep the macro from
+ * expanding twice.  Counting is a lookup in a small lock-free table.
+ */
+void request_stats_count(struct wl_proxy* proxy);
+
+/* One line, "requests: wl_surface 120, wl_buffer 4, ...". */
+void request_stats_write(FILE* fp);
+
+#define wl_proxy_marshal_flags(proxy, ...)                                    \
+    (request_stats_count(proxy), (wl_proxy_marshal_flags)(proxy, __VA_ARGS__))
+
+#endif /* REQUEST_STATS_H */
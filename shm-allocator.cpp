@@ -0,0 +1,284 @@
+#include "config.h"
+
+/* Ahead of the protocol headers, so that requests get counted. */
+#include "request-stats.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "os-compatibility.h"
+#include "shm-allocator.h"
+#include "zalloc.h"
+
+#define SHM_ALLOCATOR_MIN_SIZE ((size_t)4 << 20)
+
+struct shm_range
+{
+    size_t offset, size;
+};
+
+struct shm_allocator
+{
+    pthread_mutex_t     mutex;
+    struct wl_shm_pool* pool;
+    int                 fd;
+    char*               base;
+    size_t              reserved;
+    size_t              size;
+    size_t              used;
+
+    /* Free ranges below size, sorted by offset and never adjacent. */
+    std::vector<struct shm_range> free_list;
+};
+
+static size_t page_align(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return (size + page - 1) / page * page;
+}
+
+/*
+ * Address space set aside for the pool: as much as a wl_shm_pool can
+ * ever be, its size being an int32_t.  Reserving it costs no memory.
+ */
+static size_t reserve_size(void)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return (size_t)INT32_MAX / page * page;
+}
+
+struct shm_allocator* shm_allocator_create(size_t size)
+{
+    struct shm_allocator* allocator;
+    size_t                reserved = reserve_size();
+    void*                 base;
+
+    allocator = new (std::nothrow) struct shm_allocator();
+    if (!allocator)
+        return NULL;
+
+    base = mmap(NULL, reserved, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        delete allocator;
+        return NULL;
+    }
+
+    /* faulted in now, so that the first frames do not take the faults */
+    allocator->size = std::min(std::max(page_align(size),
+                                        SHM_ALLOCATOR_MIN_SIZE),
+                               reserved);
+    allocator->fd   = os_create_anonymous_file(allocator->size);
+    if (allocator->fd < 0 ||
+        mmap(base, allocator->size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED | MAP_POPULATE, allocator->fd,
+             0) == MAP_FAILED)
+    {
+        if (allocator->fd >= 0)
+            close(allocator->fd);
+        munmap(base, reserved);
+        delete allocator;
+        return NULL;
+    }
+
+    pthread_mutex_init(&allocator->mutex, NULL);
+    allocator->base     = (char*)base;
+    allocator->reserved = reserved;
+    allocator->free_list.push_back({0, allocator->size});
+
+    return allocator;
+}
+
+void shm_allocator_bind(struct shm_allocator* allocator, struct wl_shm* shm)
+{
+    pthread_mutex_lock(&allocator->mutex);
+    allocator->pool =
+        wl_shm_create_pool(shm, allocator->fd, (int32_t)allocator->size);
+    pthread_mutex_unlock(&allocator->mutex);
+}
+
+void shm_allocator_destroy(struct shm_allocator* allocator)
+{
+    if (allocator->pool)
+        wl_shm_pool_destroy(allocator->pool);
+    munmap(allocator->base, allocator->reserved);
+    close(allocator->fd);
+    pthread_mutex_destroy(&allocator->mutex);
+    delete allocator;
+}
+
+/* Put a range back, merging it with its neighbours. */
+static void free_range(struct shm_allocator* allocator,
+                       size_t                offset,
+                       size_t                size)
+{
+    std::vector<struct shm_range>& list = allocator->free_list;
+    size_t                         i    = 0;
+
+    while (i < list.size() && list[i].offset < offset)
+        i++;
+
+    if (i > 0 && list[i - 1].offset + list[i - 1].size == offset)
+        list[--i].size += size;
+    else
+        list.insert(list.begin() + i, {offset, size});
+
+    if (i + 1 < list.size() &&
+        list[i].offset + list[i].size == list[i + 1].offset)
+    {
+        list[i].size += list[i + 1].size;
+        list.erase(list.begin() + i + 1);
+    }
+}
+
+/*
+ * Grow the file so that at least size more bytes are free at its end.
+ * The size at least doubles, so a burst of allocations costs few
+ * resizes.
+ */
+static int grow(struct shm_allocator* allocator, size_t size)
+{
+    size_t tail = 0, new_size;
+
+    if (!allocator->free_list.empty())
+    {
+        const struct shm_range& last = allocator->free_list.back();
+
+        if (last.offset + last.size == allocator->size)
+            tail = last.size;
+    }
+
+    new_size = std::max(allocator->size * 2, allocator->size - tail + size);
+    if (new_size > allocator->reserved)
+        new_size = allocator->size - tail + size;
+    if (new_size > allocator->reserved)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (os_resize_anonymous_file(allocator->fd, new_size) < 0)
+        return -1;
+
+    if (mmap(allocator->base + allocator->size, new_size - allocator->size,
+             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, allocator->fd,
+             allocator->size) == MAP_FAILED)
+        return -1;
+
+    if (allocator->pool)
+        wl_shm_pool_resize(allocator->pool, (int32_t)new_size);
+    free_range(allocator, allocator->size, new_size - allocator->size);
+    allocator->size = new_size;
+
+    return 0;
+}
+
+int shm_allocator_alloc(struct shm_allocator* allocator,
+                        size_t                size,
+                        struct shm_block*     block)
+{
+    std::vector<struct shm_range>& list = allocator->free_list;
+    size_t                         i;
+    int                            ret = 0;
+
+    size = page_align(size);
+
+    pthread_mutex_lock(&allocator->mutex);
+
+    for (i = 0; i < list.size(); i++)
+    {
+        if (list[i].size >= size)
+            break;
+    }
+    if (i == list.size())
+    {
+        if (grow(allocator, size) < 0)
+        {
+            ret = -1;
+            goto out;
+        }
+        i = list.size() - 1;
+    }
+
+    block->offset = list[i].offset;
+    block->size   = size;
+    block->data   = allocator->base + list[i].offset;
+
+    list[i].offset += size;
+    list[i].size -= size;
+    if (!list[i].size)
+        list.erase(list.begin() + i);
+    allocator->used += size;
+
+out:
+    pthread_mutex_unlock(&allocator->mutex);
+
+    return ret;
+}
+
+void shm_allocator_free(struct shm_allocator*   allocator,
+                        const struct shm_block* block)
+{
+    if (!block->size)
+        return;
+
+    pthread_mutex_lock(&allocator->mutex);
+    free_range(allocator, block->offset, block->size);
+    allocator->used -= block->size;
+    pthread_mutex_unlock(&allocator->mutex);
+}
+
+struct wl_buffer* shm_allocator_create_buffer(struct shm_allocator*   allocator,
+                                              const struct shm_block* block,
+                                              int32_t                 width,
+                                              int32_t                 height,
+                                              int32_t                 stride,
+                                              uint32_t                format)
+{
+    struct wl_buffer* buffer;
+
+    /* the pool proxy is shared, keep resizes and creates in order */
+    pthread_mutex_lock(&allocator->mutex);
+    buffer = wl_shm_pool_create_buffer(allocator->pool, (int32_t)block->offset,
+                                       width, height, stride, format);
+    pthread_mutex_unlock(&allocator->mutex);
+
+    return buffer;
+}
+
+size_t shm_allocator_mapped(struct shm_allocator* allocator)
+{
+    size_t size;
+
+    pthread_mutex_lock(&allocator->mutex);
+    size = allocator->size;
+    pthread_mutex_unlock(&allocator->mutex);
+
+    return size;
+}
+
+size_t shm_allocator_used(struct shm_allocator* allocator)
+{
+    size_t used;
+
+    pthread_mutex_lock(&allocator->mutex);
+    used = allocator->used;
+    pthread_mutex_unlock(&allocator->mutex);
+
+    return used;
+}
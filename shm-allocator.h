@@ -0,0 +1,63 @@
+#ifndef SHM_ALLOCATOR_H
+#define SHM_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct wl_buffer;
+struct wl_shm;
+struct shm_allocator;
+
+/*
+ * One wl_shm_pool for every buffer of the process.
+ *
+ * The pool's file is mapped into a fixed address range reserved up front,
+ * so growing it only maps the new tail: blocks never move, and render
+ * threads can keep drawing into their buffers while another thread
+ * grows the pool.  Blocks are page aligned and handed out first fit from
+ * a coalescing free list; the file itself never shrinks.
+ *
+ * The file comes from os_create_anonymous_file(): a memfd where config.h
+ * has HAVE_MEMFD_CREATE, otherwise an unlinked file in XDG_RUNTIME_DIR.
+ *
+ * The pool's file is made and faulted in without a connection, so it can
+ * be set up while the client waits on the compositor; wl_buffers can be
+ * made once it is bound to a wl_shm.
+ *
+ * All calls are thread safe.
+ */
+struct shm_block
+{
+    size_t offset;
+    size_t size;
+    void*  data;
+};
+
+/* A pool of at least size bytes, all of them faulted in. */
+struct shm_allocator* shm_allocator_create(size_t size);
+
+void shm_allocator_bind(struct shm_allocator* allocator, struct wl_shm* shm);
+
+void shm_allocator_destroy(struct shm_allocator* allocator);
+
+/* Returns 0 and fills in block, or -1 with errno set. */
+int shm_allocator_alloc(struct shm_allocator* allocator,
+                        size_t                size,
+                        struct shm_block*     block);
+
+void shm_allocator_free(struct shm_allocator*   allocator,
+                        const struct shm_block* block);
+
+struct wl_buffer* shm_allocator_create_buffer(struct shm_allocator*   allocator,
+                                              const struct shm_block* block,
+                                              int32_t                 width,
+                                              int32_t                 height,
+                                              int32_t                 stride,
+                                              uint32_t                format);
+
+/* Bytes of the pool file, and of it handed out to blocks. */
+size_t shm_allocator_mapped(struct shm_allocator* allocator);
+
+size_t shm_allocator_used(struct shm_allocator* allocator);
+
+#endif /* SHM_ALLOCATOR_H */
@@ -0,0 +1,324 @@
+#include "config.h"
+
+/* Ahead of the protocol headers, so that requests get counted. */
+#include "request-stats.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <wayland-client.h>
+
+#include "surface-state.h"
+#include "viewporter-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+#define STATE_PARENT (1 << 0)
+#define STATE_MAXIMIZED (1 << 1)
+#define STATE_SCALE (1 << 2)
+#define STATE_DESTINATION (1 << 3)
+#define STATE_FULLSCREEN (1 << 4)
+
+void surface_state_init(struct surface_state* state,
+                        struct wl_compositor* compositor,
+                        struct wl_surface*    surface,
+                        struct xdg_toplevel*  toplevel)
+{
+    memset(state, 0, sizeof *state);
+    state->compositor      = compositor;
+    state->surface         = surface;
+    state->toplevel        = toplevel;
+    state->scale           = 1;
+    state->sent_scale      = 1;
+    state->dst_width       = -1;
+    state->dst_height      = -1;
+    state->sent_dst_width  = -1;
+    state->sent_dst_height = -1;
+}
+
+void surface_state_release(struct surface_state* state)
+{
+    free(state->opaque.ops);
+    free(state->input.ops);
+    free(state->sent_opaque.ops);
+    free(state->sent_input.ops);
+}
+
+void surface_state_set_parent(struct surface_state* state,
+                              struct xdg_toplevel*  parent)
+{
+    state->parent = parent;
+    state->touched |= STATE_PARENT;
+}
+
+void surface_state_set_maximized(struct surface_state* state, bool maximized)
+{
+    state->maximized = maximized;
+    state->touched |= STATE_MAXIMIZED;
+}
+
+void surface_state_set_fullscreen(struct surface_state* state,
+                                  bool                  fullscreen,
+                                  struct wl_output*     output)
+{
+    state->fullscreen        = fullscreen;
+    state->fullscreen_output = fullscreen ? output : NULL;
+    state->touched |= STATE_FULLSCREEN;
+}
+
+void surface_state_set_scale(struct surface_state* state, int32_t scale)
+{
+    state->scale = scale;
+    state->touched |= STATE_SCALE;
+}
+
+void surface_state_set_viewport(struct surface_state* state,
+                                struct wp_viewport*   viewport)
+{
+    state->viewport = viewport;
+}
+
+void surface_state_set_destination(struct surface_state* state,
+                                   int32_t               width,
+                                   int32_t               height)
+{
+    state->dst_width  = width;
+    state->dst_height = height;
+    state->touched |= STATE_DESTINATION;
+}
+
+void region_state_reset(struct region_state* region, bool set)
+{
+    region->set     = set;
+    region->touched = true;
+    region->failed  = false;
+    region->n_ops   = 0;
+}
+
+static void region_state_push(struct region_state* region,
+                              enum region_op_type  type,
+                              int32_t              x,
+                              int32_t              y,
+                              int32_t              width,
+                              int32_t              height)
+{
+    struct region_op* ops;
+    int               capacity;
+
+    if (region->n_ops == region->capacity)
+    {
+        capacity = region->capacity ? region->capacity * 2 : 16;
+        ops      = (struct region_op*)realloc(region->ops,
+                                              capacity * sizeof *ops);
+        if (!ops)
+        {
+            region->failed = true;
+            return;
+        }
+        region->ops      = ops;
+        region->capacity = capacity;
+    }
+
+    region->ops[region->n_ops++] = {type, x, y, width, height};
+    region->set                  = true;
+}
+
+void region_state_add(struct region_state* region,
+                      int32_t              x,
+                      int32_t              y,
+                      int32_t              width,
+                      int32_t              height)
+{
+    region_state_push(region, REGION_OP_ADD, x, y, width, height);
+}
+
+void region_state_subtract(struct region_state* region,
+                           int32_t              x,
+                           int32_t              y,
+                           int32_t              width,
+                           int32_t              height)
+{
+    region_state_push(region, REGION_OP_SUBTRACT, x, y, width, height);
+}
+
+static bool region_state_equal(const struct region_state* a,
+                               const struct region_state* b)
+{
+    return a->set == b->set && a->n_ops == b->n_ops &&
+        (!a->n_ops || memcmp(a->ops, b->ops, a->n_ops * sizeof *a->ops) == 0);
+}
+
+/* On failure dst keeps its old value and the region is sent again. */
+static void region_state_copy(struct region_state*       dst,
+                              const struct region_state* src)
+{
+    struct region_op* ops;
+
+    if (dst->capacity < src->n_ops)
+    {
+        ops = (struct region_op*)realloc(dst->ops,
+                                         src->n_ops * sizeof *ops);
+        if (!ops)
+            return;
+        dst->ops      = ops;
+        dst->capacity = src->n_ops;
+    }
+
+    if (src->n_ops)
+        memcpy(dst->ops, src->ops, src->n_ops * sizeof *src->ops);
+    dst->n_ops = src->n_ops;
+    dst->set   = src->set;
+}
+
+static struct wl_region* create_region(struct surface_state*      state,
+                                       const struct region_state* desc)
+{
+    struct wl_region* region;
+
+    if (!desc->set)
+        return NULL;
+
+    region = wl_compositor_create_region(state->compositor);
+    for (int i = 0; i < desc->n_ops; i++)
+    {
+        const struct region_op* op = &desc->ops[i];
+
+        if (op->type == REGION_OP_ADD)
+            wl_region_add(region, op->x, op->y, op->width, op->height);
+        else
+            wl_region_subtract(region, op->x, op->y, op->width, op->height);
+    }
+
+    return region;
+}
+
+/* Returns whether the region needs to be sent. */
+static bool region_changed(struct surface_state* state,
+                           struct region_state*  region,
+                           struct region_state*  sent)
+{
+    if (!region->touched)
+        return false;
+
+    region->touched = false;
+    if (region->failed)
+        return false;
+
+    if (region_state_equal(region, sent))
+    {
+        state->suppressed++;
+        return false;
+    }
+
+    region_state_copy(sent, region);
+    state->sent++;
+
+    return true;
+}
+
+void surface_state_flush(struct surface_state* state)
+{
+    struct wl_region* region;
+
+    if (state->touched & STATE_PARENT && state->toplevel)
+    {
+        if (state->parent != state->sent_parent)
+        {
+            xdg_toplevel_set_parent(state->toplevel, state->parent);
+            state->sent_parent = state->parent;
+            state->sent++;
+        }
+        else
+        {
+            state->suppressed++;
+        }
+    }
+
+    if (state->touched & STATE_MAXIMIZED && state->toplevel)
+    {
+        if (state->maximized != state->sent_maximized)
+        {
+            if (state->maximized)
+                xdg_toplevel_set_maximized(state->toplevel);
+            else
+                xdg_toplevel_unset_maximized(state->toplevel);
+            state->sent_maximized = state->maximized;
+            state->sent++;
+        }
+        else
+        {
+            state->suppressed++;
+        }
+    }
+
+    if (state->touched & STATE_FULLSCREEN && state->toplevel)
+    {
+        if (state->fullscreen != state->sent_fullscreen ||
+            state->fullscreen_output != state->sent_fullscreen_output)
+        {
+            if (state->fullscreen)
+                xdg_toplevel_set_fullscreen(state->toplevel,
+                                            state->fullscreen_output);
+            else
+                xdg_toplevel_unset_fullscreen(state->toplevel);
+            state->sent_fullscreen        = state->fullscreen;
+            state->sent_fullscreen_output = state->fullscreen_output;
+            state->sent++;
+        }
+        else
+        {
+            state->suppressed++;
+        }
+    }
+
+    /* older surfaces are always scale 1 */
+    if (state->touched & STATE_SCALE &&
+        wl_surface_get_version(state->surface) >=
+            WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION)
+    {
+        if (state->scale != state->sent_scale)
+        {
+            wl_surface_set_buffer_scale(state->surface, state->scale);
+            state->sent_scale = state->scale;
+            state->sent++;
+        }
+        else
+        {
+            state->suppressed++;
+        }
+    }
+
+    if (state->touched & STATE_DESTINATION && state->viewport)
+    {
+        if (state->dst_width != state->sent_dst_width ||
+            state->dst_height != state->sent_dst_height)
+        {
+            wp_viewport_set_destination(state->viewport, state->dst_width,
+                                        state->dst_height);
+            state->sent_dst_width  = state->dst_width;
+            state->sent_dst_height = state->dst_height;
+            state->sent++;
+        }
+        else
+        {
+            state->suppressed++;
+        }
+    }
+    state->touched = 0;
+
+    if (region_changed(state, &state->opaque, &state->sent_opaque))
+    {
+        region = create_region(state, &state->opaque);
+        wl_surface_set_opaque_region(state->surface, region);
+        if (region)
+            wl_region_destroy(region);
+    }
+
+    if (region_changed(state, &state->input, &state->sent_input))
+    {
+        region = create_region(state, &state->input);
+        wl_surface_set_input_region(state->surface, region);
+        if (region)
+            wl_region_destroy(region);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef SURFACE_STATE_H
+#define SURFACE_STATE_H
+
+#include <stdint.h>
+
+struct wl_compositor;
+struct wl_output;
+struct wl_surface;
+struct xdg_toplevel;
+struct wp_viewport;
+
+enum region_op_type
+{
+    REGION_OP_ADD,
+    REGION_OP_SUBTRACT,
+};
+
+struct region_op
+{
+    enum region_op_type type;
+    int32_t             x, y, width, height;
+};
+
+/*
+ * A wl_region kept as the list of operations that builds it.  An unset
+ * region stands for passing NULL, which is the protocol default for both
+ * the opaque (empty) and the input (infinite) region.  A region that
+ * lost an operation to a failed allocation is failed until the next
+ * reset, and is not sent: a stale region beats a wrong one.
+ */
+struct region_state
+{
+    bool              set;
+    bool              touched;
+    bool              failed;
+    struct region_op* ops;
+    int               n_ops, capacity;
+};
+
+/*
+ * Double-buffered surface state: what the window wants, and what the
+ * compositor was last told.  Callers describe the full desired state as
+ * often as they like; surface_state_flush() sends only what changed, just
+ * before the wl_surface.commit that latches it.  Every request that was
+ * asked for but did not need sending is counted in suppressed.
+ *
+ * The "sent" side starts out at the protocol defaults, so asking for a
+ * default value is suppressed too.  A destination of -1x-1 is the unset
+ * wp_viewport default.
+ */
+struct surface_state
+{
+    struct wl_compositor* compositor;
+    struct wl_surface*    surface;
+    struct xdg_toplevel*  toplevel;
+    struct wp_viewport*   viewport;
+
+    struct xdg_toplevel* parent;
+    bool                 maximized;
+    bool                 fullscreen;
+    struct wl_output*    fullscreen_output;
+    int32_t              scale;
+    int32_t              dst_width, dst_height;
+    struct region_state  opaque;
+    struct region_state  input;
+    uint32_t             touched;
+
+    struct xdg_toplevel* sent_parent;
+    bool                 sent_maximized;
+    bool                 sent_fullscreen;
+    struct wl_output*    sent_fullscreen_output;
+    int32_t              sent_scale;
+    int32_t              sent_dst_width, sent_dst_height;
+    struct region_state  sent_opaque;
+    struct region_state  sent_input;
+
+    uint64_t sent;
+    uint64_t suppressed;
+};
+
+/* toplevel is NULL for surfaces without a role, such as subsurfaces. */
+void surface_state_init(struct surface_state* state,
+                        struct wl_compositor* compositor,
+                        struct wl_surface*    surface,
+                        struct xdg_toplevel*  toplevel);
+
+void surface_state_release(struct surface_state* state);
+
+void surface_state_set_parent(struct surface_state* state,
+                              struct xdg_toplevel*  parent);
+
+void surface_state_set_maximized(struct surface_state* state, bool maximized);
+
+/* output is where to go fullscreen, NULL lets the compositor choose. */
+void surface_state_set_fullscreen(struct surface_state* state,
+                                  bool                  fullscreen,
+                                  struct wl_output*     output);
+
+void surface_state_set_scale(struct surface_state* state, int32_t scale);
+
+/* Only takes effect once a viewport has been given with set_viewport. */
+void surface_state_set_viewport(struct surface_state* state,
+                                struct wp_viewport*   viewport);
+
+void surface_state_set_destination(struct surface_state* state,
+                                   int32_t               width,
+                                   int32_t               height);
+
+/* Start describing a region afresh; set false means NULL. */
+void region_state_reset(struct region_state* region, bool set);
+
+void region_state_add(struct region_state* region,
+                      int32_t              x,
+                      int32_t              y,
+                      int32_t              width,
+                      int32_t              height);
+
+void region_state_subtract(struct region_state* region,
+                           int32_t              x,
+                           int32_t              y,
+                           int32_t              width,
+                           int32_t              height);
+
+void surface_state_flush(struct surface_state* state);
+
+#endif /* SURFACE_STATE_H */
@@ -0,0 +1,274 @@
+#include "config.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+
+#include "thread-pool.h"
+#include "trace.h"
+#include "zalloc.h"
+
+/* One range of task indices; the owner and thieves both claim from next. */
+struct task_range
+{
+    alignas(64) std::atomic<int> next;
+    int end;
+};
+
+struct worker
+{
+    struct thread_pool* pool;
+    int                 index;
+    pthread_t           thread;
+};
+
+struct thread_pool
+{
+    int            n_threads;
+    struct worker* workers;
+
+    /* Held for the whole of a job, callers take turns. */
+    pthread_mutex_t run_mutex;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  start_cond;
+    pthread_cond_t  done_cond;
+    unsigned        generation;
+    int             busy;
+    bool            quit;
+
+    thread_pool_func_t func;
+    void*              data;
+    struct task_range* ranges;
+};
+
+static bool claim(struct task_range* range, int* task)
+{
+    if (range->next.load(std::memory_order_relaxed) >= range->end)
+        return false;
+
+    *task = range->next.fetch_add(1, std::memory_order_relaxed);
+
+    return *task < range->end;
+}
+
+static void run_task(struct thread_pool* pool, int task)
+{
+    trace_begin("pool", "task");
+    pool->func(task, pool->data);
+    trace_end("pool", "task");
+}
+
+/* Drain our own range, then help whoever has the most left. */
+static void work(struct thread_pool* pool, int self)
+{
+    int task, victim, left, most;
+
+    while (claim(&pool->ranges[self], &task))
+        run_task(pool, task);
+
+    for (;;)
+    {
+        victim = -1;
+        most   = 0;
+        for (int i = 0; i < pool->n_threads; i++)
+        {
+            left = pool->ranges[i].end -
+                pool->ranges[i].next.load(std::memory_order_relaxed);
+            if (left > most)
+            {
+                most   = left;
+                victim = i;
+            }
+        }
+        if (victim < 0)
+            return;
+
+        while (claim(&pool->ranges[victim], &task))
+            run_task(pool, task);
+    }
+}
+
+static void* worker_main(void* data)
+{
+    struct worker*      worker = (struct worker*)data;
+    struct thread_pool* pool   = worker->pool;
+    unsigned            seen   = 0;
+    char                name[32];
+
+    snprintf(name, sizeof name, "pool worker %d", worker->index);
+    trace_thread_name(name);
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        work(pool, worker->index);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+int thread_pool_cpu_count(void)
+{
+    cpu_set_t set;
+
+    if (sched_getaffinity(0, sizeof set, &set) < 0)
+        return 1;
+
+    return CPU_COUNT(&set) > 0 ? CPU_COUNT(&set) : 1;
+}
+
+/* Pin the thread to the n-th CPU we are allowed to run on. */
+static void set_affinity(pthread_t thread, int n)
+{
+    cpu_set_t allowed, set;
+    int       cpu;
+
+    if (sched_getaffinity(0, sizeof allowed, &allowed) < 0)
+        return;
+
+    n %= CPU_COUNT(&allowed);
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed) && n-- == 0)
+            break;
+    }
+    if (cpu == CPU_SETSIZE)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread, sizeof set, &set);
+}
+
+struct thread_pool* thread_pool_create(int n_threads)
+{
+    struct thread_pool* pool;
+    sigset_t            all, saved;
+    int                 i;
+
+    if (n_threads < 1)
+        n_threads = 1;
+
+    pool = (struct thread_pool*)zalloc(sizeof *pool);
+    if (!pool)
+        return NULL;
+
+    pool->workers =
+        (struct worker*)zalloc(n_threads * sizeof *pool->workers);
+    pool->ranges = new (std::nothrow) struct task_range[n_threads];
+    if (!pool->workers || !pool->ranges)
+    {
+        delete[] pool->ranges;
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->run_mutex, NULL);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    /* the workers inherit a fully blocked mask */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+
+    pool->n_threads = 1;
+    for (i = 1; i < n_threads; i++)
+    {
+        pool->workers[i].pool  = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main,
+                           &pool->workers[i]) != 0)
+            break;
+        set_affinity(pool->workers[i].thread, i);
+        pool->n_threads++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    return pool;
+}
+
+void thread_pool_destroy(struct thread_pool* pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 1; i < pool->n_threads; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->run_mutex);
+    pthread_mutex_destroy(&pool->mutex);
+    delete[] pool->ranges;
+    free(pool->workers);
+    free(pool);
+}
+
+int thread_pool_size(const struct thread_pool* pool)
+{
+    return pool->n_threads;
+}
+
+void thread_pool_run(struct thread_pool* pool,
+                     int                 n_tasks,
+                     thread_pool_func_t  func,
+                     void*               data)
+{
+    int n = pool->n_threads;
+
+    if (n == 1 || n_tasks <= 1)
+    {
+        for (int i = 0; i < n_tasks; i++)
+            func(i, data);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->run_mutex);
+
+    for (int i = 0; i < n; i++)
+    {
+        pool->ranges[i].next.store((long)n_tasks * i / n,
+                                   std::memory_order_relaxed);
+        pool->ranges[i].end = (long)n_tasks * (i + 1) / n;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->func = func;
+    pool->data = data;
+    pool->busy = n - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    work(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_mutex_unlock(&pool->run_mutex);
+}
@@ -0,0 +1,35 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/*
+ * A persistent pool of worker threads for data-parallel jobs.
+ *
+ * thread_pool_run() splits n_tasks task indices into one contiguous
+ * range per thread and blocks until every task has run.  The calling
+ * thread takes part as the first worker.  Each thread starts on its
+ * own range, and once that is empty it steals what is left of the
+ * others, so a few expensive tasks do not hold the whole job up.
+ *
+ * Workers are pinned one per allowed CPU, and all signals are blocked
+ * in them.  A pool of one thread runs everything inline.  Jobs started
+ * from several threads at once run one after the other.
+ */
+struct thread_pool;
+
+typedef void (*thread_pool_func_t)(int task, void* data);
+
+struct thread_pool* thread_pool_create(int n_threads);
+
+void thread_pool_destroy(struct thread_pool* pool);
+
+int thread_pool_size(const struct thread_pool* pool);
+
+void thread_pool_run(struct thread_pool* pool,
+                     int                 n_tasks,
+                     thread_pool_func_t  func,
+                     void*               data);
+
+/* Online CPUs this process may run on. */
+int thread_pool_cpu_count(void);
+
+#endif /* THREAD_POOL_H */
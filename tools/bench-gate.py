@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""
+Benchmark regression gate.
+
+Runs the benchmark suites several times, takes the median of every
+metric with a distribution-free confidence interval, and compares the
+medians with a checked-in baseline:
+
+    micro     bench/micro: ns per pixel of every kernel at every size,
+              and allocation latency percentiles.
+    headless  the overlay against bench/mock-compositor: frames per
+              second, callback to commit and commit to release latency,
+              the client's time to its first commit and its own
+              per-phase frame timings (-T).
+
+A metric fails the gate when its median is worse than the baseline's by
+more than the threshold and the two confidence intervals do not
+overlap, so a noisy metric has to be consistently worse to fail.
+Metrics missing from the baseline are shown but never fail; a suite
+without any baseline metrics fails, as it would gate nothing.
+
+Usage, from the top of the tree after `make bench`:
+
+    tools/bench-gate.py [--runs N] [--threshold PCT] [--suite NAME ...]
+                        [--baseline PATH] [--update]
+
+--update runs the suites and writes their medians as the new baseline
+for those suites instead of comparing.  Baselines hold for the machine
+they were taken on; take a new one when the machine changes.
+"""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+DEFAULT_BASELINE = "bench/baseline.json"
+DEFAULT_THRESHOLD = 10.0
+DEFAULT_RUNS = 5
+CONFIDENCE = 0.95
+
+# Client phases worth gating; acquire and release wait on the compositor.
+FRAME_PHASES = ("decode", "clear", "convert", "submit")
+
+
+def run_micro(args):
+    out = subprocess.run(["./bench/micro", str(args.micro_iterations)],
+                         check=True, stdout=subprocess.PIPE).stdout
+    report = json.loads(out)
+    metrics = {}
+
+    for k in report["kernels"]:
+        name = "micro/%s/%s/ns_per_pixel" % (k["kernel"], k["size"])
+        metrics[name] = k["ns_per_pixel"]
+    for a in report["allocation"]:
+        for p in ("p50_ns", "p99_ns"):
+            metrics["micro/%s/%s/%s" % (a["op"], a["size"], p)] = a[p]
+
+    return metrics
+
+
+def run_headless(args):
+    with tempfile.TemporaryDirectory() as tmp:
+        timings_path = os.path.join(tmp, "timings.json")
+        out = subprocess.run(["./bench/mock-compositor",
+                              "-d", str(args.duration), "--",
+                              "./WaylandWnd", "-T", timings_path],
+                             check=True, stdout=subprocess.PIPE).stdout
+        report = json.loads(out)
+        with open(timings_path) as f:
+            timings = json.load(f)
+
+    metrics = {"headless/fps": report["fps"],
+               "headless/time_to_first_commit_ns":
+               timings["time_to_first_commit_ns"]}
+    for h in ("frame_to_commit", "commit_to_release"):
+        for p in ("p50_ns", "p90_ns"):
+            metrics["headless/%s/%s" % (h, p)] = report[h][p]
+    for i, window in enumerate(timings["windows"]):
+        for phase in FRAME_PHASES:
+            for p in ("p50_ns", "p90_ns"):
+                name = "headless/window%d/%s/%s" % (i, phase, p)
+                metrics[name] = window[phase][p]
+
+    return metrics
+
+
+SUITES = {"micro": run_micro, "headless": run_headless}
+
+
+class BenchError(Exception):
+    pass
+
+
+def run_suite(suite, args):
+    """One run of a suite, with its failures made readable."""
+    try:
+        return SUITES[suite](args)
+    except FileNotFoundError as e:
+        raise BenchError("%s: %s not found, run `make bench` first"
+                         % (suite, e.filename))
+    except subprocess.CalledProcessError as e:
+        raise BenchError("%s: %s exited with status %d"
+                         % (suite, e.cmd[0], e.returncode))
+    except (ValueError, KeyError) as e:
+        raise BenchError("%s: unexpected output: %s" % (suite, e))
+
+
+def higher_is_better(name):
+    return name.endswith("/fps")
+
+
+def median(values):
+    v = sorted(values)
+    n = len(v)
+
+    return v[n // 2] if n % 2 else (v[n // 2 - 1] + v[n // 2]) / 2.0
+
+
+def median_interval(values):
+    """
+    Confidence interval of the median from order statistics: the k-th
+    smallest and k-th largest run, k as large as the binomial tail
+    allows.  With few runs it is the whole range, at whatever
+    confidence that gives.
+    """
+    v = sorted(values)
+    n = len(v)
+    k, tail = 0, 0.0
+
+    while k + 1 < n - k:
+        p = math.comb(n, k) / 2.0 ** n
+        if 2.0 * (tail + p) > 1.0 - CONFIDENCE:
+            break
+        tail += p
+        k += 1
+
+    return v[max(k - 1, 0)], v[n - max(k, 1)]
+
+
+def summarize(samples):
+    summary = {}
+
+    for name, values in samples.items():
+        low, high = median_interval(values)
+        summary[name] = {"median": median(values), "ci": [low, high]}
+
+    return summary
+
+
+def intervals_apart(a, b):
+    return a[0] > b[1] or a[1] < b[0]
+
+
+def compare(summary, baseline, threshold):
+    """Rows of the diff table, and whether any metric regressed."""
+    rows = []
+    failed = False
+
+    for name in sorted(set(summary) | set(baseline)):
+        if name not in summary:
+            rows.append((name, baseline[name]["median"], None, None, None,
+                         "missing"))
+            continue
+
+        cur = summary[name]
+        if name not in baseline:
+            rows.append((name, None, cur["median"], cur["ci"], None, "new"))
+            continue
+
+        base = baseline[name]["median"]
+        change = (cur["median"] - base) / base * 100.0 if base else 0.0
+        worse = -change if higher_is_better(name) else change
+        apart = intervals_apart(cur["ci"], baseline[name]["ci"])
+
+        if worse > threshold and apart:
+            status = "REGRESSED"
+            failed = True
+        elif worse < -threshold and apart:
+            status = "improved"
+        else:
+            status = "ok"
+        rows.append((name, base, cur["median"], cur["ci"], change, status))
+
+    return rows, failed
+
+
+def number(value):
+    if value is None:
+        return "-"
+    if abs(value) >= 1000:
+        return "%.0f" % value
+    return "%.4g" % value
+
+
+def print_table(rows):
+    header = ("metric", "baseline", "median", "ci", "change", "status")
+    lines = [header]
+
+    for name, base, cur, ci, change, status in rows:
+        lines.append((name, number(base), number(cur),
+                      "[%s, %s]" % (number(ci[0]), number(ci[1]))
+                      if ci else "-",
+                      "%+.1f%%" % change if change is not None else "-",
+                      status))
+
+    widths = [max(len(line[i]) for line in lines) for i in range(6)]
+    for line in lines:
+        print("  ".join(cell.ljust(w) if i == 0 else cell.rjust(w)
+                        for i, (cell, w) in enumerate(zip(line, widths)))
+              .rstrip())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark regression gate")
+    parser.add_argument("--runs", type=int, default=DEFAULT_RUNS)
+    parser.add_argument("--threshold", type=float, default=None,
+                        help="allowed slowdown in percent, default %.0f "
+                        "or the baseline's own" % DEFAULT_THRESHOLD)
+    parser.add_argument("--suite", action="append", choices=sorted(SUITES),
+                        help="suite to run, repeatable; default all")
+    parser.add_argument("--baseline", default=DEFAULT_BASELINE)
+    parser.add_argument("--update", action="store_true",
+                        help="write the results as the new baseline")
+    parser.add_argument("--micro-iterations", type=int, default=10)
+    parser.add_argument("--duration", type=float, default=5.0,
+                        help="seconds per headless run")
+    args = parser.parse_args()
+
+    if args.runs < 1:
+        parser.error("--runs must be at least 1")
+
+    suites = args.suite or sorted(SUITES)
+    prefixes = tuple(s + "/" for s in suites)
+
+    try:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    except FileNotFoundError:
+        if not args.update:
+            print("no baseline at %s, take one with --update"
+                  % args.baseline, file=sys.stderr)
+            return 1
+        baseline = {"threshold": DEFAULT_THRESHOLD, "metrics": {}}
+
+    # Only what was run is compared or replaced.
+    metrics = {name: m for name, m in baseline["metrics"].items()
+               if name.startswith(prefixes)}
+
+    if not args.update:
+        missing = [s for s in suites
+                   if not any(name.startswith(s + "/") for name in metrics)]
+        if missing:
+            for suite in missing:
+                print("no baseline for the %s suite in %s, take one with "
+                      "--update --suite %s" % (suite, args.baseline, suite),
+                      file=sys.stderr)
+            return 1
+
+    # Without memfd_create() shm files need XDG_RUNTIME_DIR; outside a
+    # login session the benches get a private one for the run.
+    runtime_dir = None
+    if not os.environ.get("XDG_RUNTIME_DIR"):
+        runtime_dir = tempfile.TemporaryDirectory(prefix="bench-gate-")
+        os.environ["XDG_RUNTIME_DIR"] = runtime_dir.name
+
+    samples = {}
+    try:
+        for suite in suites:
+            for run in range(args.runs):
+                print("%s: run %d of %d" % (suite, run + 1, args.runs),
+                      file=sys.stderr)
+                for name, value in run_suite(suite, args).items():
+                    samples.setdefault(name, []).append(value)
+    except BenchError as e:
+        print(e, file=sys.stderr)
+        return 1
+    finally:
+        if runtime_dir:
+            runtime_dir.cleanup()
+
+    summary = summarize(samples)
+    threshold = args.threshold
+    if threshold is None:
+        threshold = baseline.get("threshold", DEFAULT_THRESHOLD)
+
+    if args.update:
+        for name in metrics:
+            del baseline["metrics"][name]
+        baseline["metrics"].update(summary)
+        baseline["threshold"] = threshold
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=1, sort_keys=True)
+            f.write("\n")
+        print("wrote %d metrics to %s" % (len(summary), args.baseline))
+        return 0
+
+    rows, failed = compare(summary, metrics, threshold)
+    print_table(rows)
+    print("\n%d runs, %.0f%% confidence, threshold %.1f%%: %s"
+          % (args.runs, CONFIDENCE * 100, threshold,
+             "FAILED" if failed else "passed"))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,195 @@
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "clock.h"
+#include "trace.h"
+#include "zalloc.h"
+
+struct trace_event
+{
+    uint64_t    ts;
+    const char* category;
+    const char* name;
+    const char* arg_name;
+    uint64_t    arg;
+    char        phase;
+};
+
+/*
+ * Only its own thread writes to a ring, so head needs no atomics; the
+ * rings are read after the writers have synchronized with the reader.
+ */
+struct trace_ring
+{
+    struct trace_ring* next;
+    pid_t              tid;
+    char               name[32];
+    uint64_t           head;
+    struct trace_event events[TRACE_RING_SIZE];
+};
+
+std::atomic<bool> trace_on;
+
+static std::atomic<struct trace_ring*> rings;
+static thread_local struct trace_ring* thread_ring;
+
+void trace_enable(void)
+{
+    trace_on = true;
+}
+
+/* The ring of the calling thread, pushed onto the list on first use. */
+static struct trace_ring* get_ring(void)
+{
+    struct trace_ring* ring = thread_ring;
+
+    if (ring)
+        return ring;
+
+    ring = (struct trace_ring*)zalloc(sizeof *ring);
+    if (!ring)
+        return NULL;
+
+    ring->tid  = syscall(SYS_gettid);
+    ring->next = rings.load(std::memory_order_relaxed);
+    while (!rings.compare_exchange_weak(ring->next, ring,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed))
+        ;
+
+    thread_ring = ring;
+
+    return ring;
+}
+
+void trace_thread_name(const char* name)
+{
+    struct trace_ring* ring;
+
+    if (!trace_on.load(std::memory_order_relaxed))
+        return;
+
+    ring = get_ring();
+    if (ring)
+        snprintf(ring->name, sizeof ring->name, "%s", name);
+}
+
+void trace_record(char        phase,
+                  const char* category,
+                  const char* name,
+                  const char* arg_name,
+                  uint64_t    arg)
+{
+    struct trace_ring*  ring = get_ring();
+    struct trace_event* event;
+
+    if (!ring)
+        return;
+
+    event           = &ring->events[ring->head % TRACE_RING_SIZE];
+    event->ts       = clock_now_ns();
+    event->category = category;
+    event->name     = name;
+    event->arg_name = arg_name;
+    event->arg      = arg;
+    event->phase    = phase;
+    ring->head++;
+}
+
+static void write_event(FILE*                     fp,
+                        const struct trace_ring*  ring,
+                        const struct trace_event* event,
+                        bool*                     first)
+{
+    fprintf(fp,
+            "%s\n{\"ph\": \"%c\", \"cat\": \"%s\", \"name\": \"%s\", "
+            "\"pid\": %d, \"tid\": %d, \"ts\": %.3f",
+            *first ? "" : ",", event->phase, event->category, event->name,
+            getpid(), ring->tid, event->ts / 1000.0);
+    if (event->phase == 'i')
+        fprintf(fp, ", \"s\": \"t\"");
+    if (event->arg_name)
+        fprintf(fp, ", \"args\": {\"%s\": %llu}", event->arg_name,
+                (unsigned long long)event->arg);
+    fprintf(fp, "}");
+
+    *first = false;
+}
+
+/*
+ * Events are written oldest first.  An end whose begin was overwritten
+ * would close a slice that never opened, those are left out.
+ */
+static void write_ring(FILE* fp, const struct trace_ring* ring, bool* first)
+{
+    uint64_t start = 0;
+    int      depth = 0;
+
+    if (ring->name[0])
+    {
+        fprintf(fp,
+                "%s\n{\"ph\": \"M\", \"name\": \"thread_name\", "
+                "\"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                *first ? "" : ",", getpid(), ring->tid, ring->name);
+        *first = false;
+    }
+
+    if (ring->head > TRACE_RING_SIZE)
+        start = ring->head - TRACE_RING_SIZE;
+
+    for (uint64_t i = start; i < ring->head; i++)
+    {
+        const struct trace_event* event =
+            &ring->events[i % TRACE_RING_SIZE];
+
+        if (event->phase == 'B')
+            depth++;
+        if (event->phase == 'E' && depth-- == 0)
+        {
+            depth = 0;
+            continue;
+        }
+
+        write_event(fp, ring, event, first);
+    }
+}
+
+int trace_write(const char* path)
+{
+    struct trace_ring* ring;
+    FILE*              fp;
+    bool               first = true;
+
+    fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (ring = rings.load(std::memory_order_acquire); ring;
+         ring = ring->next)
+        write_ring(fp, ring, &first);
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp) != 0)
+        return -1;
+
+    return 0;
+}
+
+void trace_shutdown(void)
+{
+    struct trace_ring *ring, *next;
+
+    trace_on = false;
+    for (ring = rings.exchange(NULL); ring; ring = next)
+    {
+        next = ring->next;
+        free(ring);
+    }
+    thread_ring = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/*
+ * Timeline tracing in the Chrome trace event format, which
+ * ui.perfetto.dev and chrome://tracing open as they are.
+ *
+ * Every thread records into a ring of its own, with no locks and no
+ * allocation after its first event.  A full ring overwrites its oldest
+ * events, so the file holds the last TRACE_RING_SIZE events of each
+ * thread.  While tracing is off every call costs one relaxed load.
+ *
+ * Categories, names and argument names are stored as pointers and must
+ * outlive the trace; string literals are what they are meant for.
+ */
+#define TRACE_RING_SIZE (1 << 15)
+
+extern std::atomic<bool> trace_on;
+
+/* Start recording.  Threads that record later get their ring then. */
+void trace_enable(void);
+
+/* Name the calling thread in the trace. */
+void trace_thread_name(const char* name);
+
+void trace_record(char        phase,
+                  const char* category,
+                  const char* name,
+                  const char* arg_name,
+                  uint64_t    arg);
+
+/*
+ * Write every ring to path as a Chrome trace JSON file.  The threads that
+ * recorded must have exited or be idle since a point that synchronizes
+ * with the caller, e.g. a join.
+ */
+int trace_write(const char* path);
+
+/* Free all rings.  No thread may record afterwards. */
+void trace_shutdown(void);
+
+static inline void trace_begin(const char* category, const char* name)
+{
+    if (trace_on.load(std::memory_order_relaxed))
+        trace_record('B', category, name, NULL, 0);
+}
+
+static inline void trace_end(const char* category, const char* name)
+{
+    if (trace_on.load(std::memory_order_relaxed))
+        trace_record('E', category, name, NULL, 0);
+}
+
+/* A point event, optionally with one numeric argument. */
+static inline void trace_instant(const char* category,
+                                 const char* name,
+                                 const char* arg_name,
+                                 uint64_t    arg)
+{
+    if (trace_on.load(std::memory_order_relaxed))
+        trace_record('i', category, name, arg_name, arg);
+}
+
+#endif /* TRACE_H */